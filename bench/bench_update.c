@@ -0,0 +1,179 @@
+/*
+ * bench_update.c - ns per update_pins() call, outside LinuxCNC
+ *
+ * Plays the daemon's part on a scratch segment: writes the header and
+ * type table, then loads the bridge against it through the stub HAL
+ * and calls microkernel.update the way a servo thread would. Each run
+ * changes a share of the IN pins and OUT slots before every call.
+ *
+ *   gcc -std=gnu99 -O2 -Ibench -o bench_update bench/bench_update.c bench/hal_stub.c -lpthread
+ *   ./bench_update [calls]
+ */
+
+#define SHARED_MEM_PATH "/tmp/hal_bench.shm"
+#include "../hal_microkernel_bridge.c"
+
+#define BENCH_CALLS   2000000
+#define BENCH_PERIOD  1000000   // ns handed to update_pins, as for a 1 kHz thread
+
+static const int bench_slots[] = { 16, 64, 256 };
+static const int bench_rates[] = { 0, 1, 10, 100 };    // Percent of slots changed per call
+
+typedef struct {
+    void (*update)(void *, long);
+    void *arg;
+    hal_float_t *float_in[MAX_PINS];    // Even slots
+    hal_s32_t *s32_in[MAX_PINS];        // Odd slots
+    hal_s32_t *tmax;
+    volatile int64_t *shm;
+    int n;
+} bench_t;
+
+// The daemon's half of startup: a fresh file, types, then generation
+static volatile int64_t *bench_segment(int n) {
+    volatile int64_t *shm;
+    int fd, i;
+
+    unlink(SHARED_MEM_PATH);
+    fd = open(SHARED_MEM_PATH, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, SHARED_MEM_SIZE) != 0) {
+        close(fd);
+        return NULL;
+    }
+    shm = mmap(NULL, SHARED_MEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) return NULL;
+
+    shm[SHM_PIN_COUNT] = n;
+    shm[SHM_VERSION] = SHM_LAYOUT_VERSION;
+    shm[SHM_BACKING] = BACKING_PAGES;
+    for (i = 0; i < n; i++) {
+        ((volatile uint8_t *)&shm[SHM_TYPES])[i] = (i & 1) ? SLOT_S32 : SLOT_FLOAT;
+    }
+    shm[SHM_GENERATION] = 1;
+    return shm;
+}
+
+// Loads the bridge with one instance of n slots and finds its pins
+static int bench_load(bench_t *b, int n) {
+    char name[HAL_NAME_LEN + 1];
+    int i;
+
+    memset(b, 0, sizeof(*b));
+    b->n = n;
+    b->shm = bench_segment(n);
+    if (b->shm == NULL) {
+        fprintf(stderr, "bench: cannot create %s\n", SHARED_MEM_PATH);
+        return -1;
+    }
+
+    // A real unload discards the module's statics; reset the ones a second load depends on
+    slots[0] = n;
+    reattach_stop = 0;
+    reattach_running = 0;
+    if (rtapi_app_main() != 0) return -1;
+
+    b->update = hal_stub_funct("microkernel.update", &b->arg);
+    b->tmax = hal_stub_pin("microkernel.update.tmax");
+    for (i = 0; i < n; i++) {
+        if (i & 1) {
+            snprintf(name, sizeof(name), "microkernel.pin.%03d.in.s32", i);
+            b->s32_in[i] = hal_stub_pin(name);
+        } else {
+            snprintf(name, sizeof(name), "microkernel.pin.%03d.in.float", i);
+            b->float_in[i] = hal_stub_pin(name);
+        }
+        if (!b->s32_in[i] && !b->float_in[i]) {
+            fprintf(stderr, "bench: no IN pin for slot %d\n", i);
+            return -1;
+        }
+    }
+    if (!b->update || !b->tmax) {
+        fprintf(stderr, "bench: microkernel.update not exported\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void bench_unload(bench_t *b) {
+    rtapi_app_exit();
+    munmap((void *)b->shm, SHARED_MEM_SIZE);
+    unlink(SHARED_MEM_PATH);
+}
+
+// Before call `it`: change k IN pins, and k OUT slots as the daemon
+// would (values, write sequences and dirty bits under the OUT seqlock,
+// the bitmap starting over once the instance has acked the previous
+// frame)
+static inline void bench_touch(bench_t *b, long it, int k) {
+    volatile uint64_t *out_dirty = (volatile uint64_t *)&b->shm[SHM_OUT_DIRTY];
+    volatile int64_t *out_seq = &b->shm[SHM_OUT_SEQ];
+    int64_t seq;
+    int j, i, w;
+
+    if (k == 0) return;
+    for (j = 0; j < k; j++) {
+        i = (int)((it * k + j) % b->n);
+        if (i & 1) *(b->s32_in[i]) += 1;
+        else       *(b->float_in[i]) += 0.001;
+    }
+    seq = *out_seq;
+    __atomic_store_n(out_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (b->shm[SHM_INST(0) + INST_OUT_ACK] == seq) {
+        for (w = 0; w < DIRTY_WORDS; w++) out_dirty[w] = 0;
+    }
+    for (j = 0; j < k; j++) {
+        i = (int)((it * k + j + b->n / 2) % b->n);
+        b->shm[SHM_OUT_BASE + i] += 1;
+        b->shm[SHM_OUT_WSEQ + i] = seq + 2;
+        out_dirty[i >> 6] |= 1ULL << (i & 63);
+    }
+    __atomic_store_n(out_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Runs `calls` iterations; with update == 0 only the touching, so it
+// can be subtracted from the timed run
+static long long bench_run(bench_t *b, long calls, int k, int update) {
+    long long start = rtapi_get_time();
+    long it;
+
+    for (it = 0; it < calls; it++) {
+        bench_touch(b, it, k);
+        if (update) b->update(b->arg, BENCH_PERIOD);
+    }
+    return rtapi_get_time() - start;
+}
+
+int main(int argc, char **argv) {
+    long calls = (argc > 1) ? atol(argv[1]) : BENCH_CALLS;
+    bench_t b;
+    size_t s, r;
+
+    if (calls < 1) {
+        fprintf(stderr, "usage: %s [calls]\n", argv[0]);
+        return 1;
+    }
+    printf("update_pins(), %ld calls per row, fan-out kernel chosen at load\n", calls);
+    printf("%6s %8s %10s %10s\n", "slots", "change%", "ns/call", "tmax ns");
+    for (s = 0; s < sizeof(bench_slots) / sizeof(bench_slots[0]); s++) {
+        for (r = 0; r < sizeof(bench_rates) / sizeof(bench_rates[0]); r++) {
+            int n = bench_slots[s];
+            int k = n * bench_rates[r] / 100;
+            long long base, total;
+
+            if (bench_rates[r] > 0 && k == 0) k = 1;
+            if (bench_load(&b, n) != 0) return 1;
+            bench_run(&b, calls / 10, k, 1);            // Warm caches and branch predictors
+            *(b.tmax) = 0;
+            total = bench_run(&b, calls, k, 1);
+            base = bench_run(&b, calls, k, 0);
+            printf("%6d %8d %10.1f %10d\n", n, bench_rates[r],
+                   (double)(total - base) / calls, (int)*(b.tmax));
+            bench_unload(&b);
+        }
+    }
+    printf("fan-out: %s\n", fanout_name);
+    return 0;
+}
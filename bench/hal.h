@@ -0,0 +1,56 @@
+/*
+ * hal.h - userspace stand-in for the bench harness
+ * Pins are plain heap cells, functions are kept in a table so the
+ * bench can call them by name the way a HAL thread would.
+ */
+
+#ifndef BENCH_HAL_H
+#define BENCH_HAL_H
+
+#include "rtapi.h"
+#include <stdbool.h>
+
+#define HAL_NAME_LEN 47
+
+typedef volatile bool     hal_bit_t;
+typedef volatile int32_t  hal_s32_t;
+typedef volatile uint32_t hal_u32_t;
+typedef volatile int64_t  hal_s64_t;
+typedef volatile uint64_t hal_u64_t;
+typedef volatile double   hal_float_t;
+
+typedef enum { HAL_IN = 16, HAL_OUT = 32, HAL_IO = (HAL_IN | HAL_OUT) } hal_pin_dir_t;
+
+int hal_init(const char *name);
+int hal_ready(int comp_id);
+int hal_exit(int comp_id);                  // Frees every pin and function
+void *hal_malloc(long size);
+
+int hal_pin_bit_new(const char *name, hal_pin_dir_t dir, hal_bit_t **data_ptr_addr, int comp_id);
+int hal_pin_s32_new(const char *name, hal_pin_dir_t dir, hal_s32_t **data_ptr_addr, int comp_id);
+int hal_pin_u32_new(const char *name, hal_pin_dir_t dir, hal_u32_t **data_ptr_addr, int comp_id);
+int hal_pin_s64_new(const char *name, hal_pin_dir_t dir, hal_s64_t **data_ptr_addr, int comp_id);
+int hal_pin_u64_new(const char *name, hal_pin_dir_t dir, hal_u64_t **data_ptr_addr, int comp_id);
+int hal_pin_float_new(const char *name, hal_pin_dir_t dir, hal_float_t **data_ptr_addr, int comp_id);
+
+int hal_pin_bit_newf(hal_pin_dir_t dir, hal_bit_t **data_ptr_addr, int comp_id, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+int hal_pin_s32_newf(hal_pin_dir_t dir, hal_s32_t **data_ptr_addr, int comp_id, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+int hal_pin_u32_newf(hal_pin_dir_t dir, hal_u32_t **data_ptr_addr, int comp_id, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+int hal_pin_s64_newf(hal_pin_dir_t dir, hal_s64_t **data_ptr_addr, int comp_id, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+int hal_pin_u64_newf(hal_pin_dir_t dir, hal_u64_t **data_ptr_addr, int comp_id, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+int hal_pin_float_newf(hal_pin_dir_t dir, hal_float_t **data_ptr_addr, int comp_id, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+int hal_export_funct(const char *name, void (*funct)(void *, long), void *arg,
+                     int uses_fp, int reentrant, int comp_id);
+
+// Harness only: look up what the component exported, NULL if missing
+void *hal_stub_pin(const char *name);
+void (*hal_stub_funct(const char *name, void **arg))(void *, long);
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * hal_stub.c - userspace HAL/RTAPI for the bench harness
+ * Pins and functions go into flat tables; nothing is shared between
+ * processes and there is no locking, because the bench is one thread
+ * calling the component's functions in turn.
+ */
+
+#include "rtapi.h"
+#include "hal.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STUB_MAX_PINS   4096
+#define STUB_MAX_FUNCTS 64
+
+typedef struct {
+    char  name[HAL_NAME_LEN + 1];
+    void *ptr;
+} stub_pin_t;
+
+typedef struct {
+    char  name[HAL_NAME_LEN + 1];
+    void (*funct)(void *, long);
+    void *arg;
+} stub_funct_t;
+
+static stub_pin_t pins[STUB_MAX_PINS];
+static int num_pins;
+static stub_funct_t functs[STUB_MAX_FUNCTS];
+static int num_functs;
+static void *allocs[STUB_MAX_PINS];
+static int num_allocs;
+
+void rtapi_print_msg(int level, const char *fmt, ...) {
+    va_list ap;
+
+    (void)level;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+long long rtapi_get_time(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int hal_init(const char *name) {
+    (void)name;
+    return 1;
+}
+
+int hal_ready(int comp_id) {
+    (void)comp_id;
+    return 0;
+}
+
+int hal_exit(int comp_id) {
+    int i;
+
+    (void)comp_id;
+    for (i = 0; i < num_pins; i++) free(pins[i].ptr);
+    for (i = 0; i < num_allocs; i++) free(allocs[i]);
+    num_pins = 0;
+    num_functs = 0;
+    num_allocs = 0;
+    return 0;
+}
+
+void *hal_malloc(long size) {
+    void *p;
+
+    if (num_allocs == STUB_MAX_PINS) return NULL;
+    p = calloc(1, size);
+    if (p) allocs[num_allocs++] = p;
+    return p;
+}
+
+static int pin_new(const char *name, void **ptr, size_t size) {
+    if (num_pins == STUB_MAX_PINS) return -1;
+    *ptr = calloc(1, size);
+    if (!*ptr) return -1;
+    snprintf(pins[num_pins].name, sizeof(pins[num_pins].name), "%s", name);
+    pins[num_pins].ptr = *ptr;
+    num_pins++;
+    return 0;
+}
+
+#define PIN_NEW(type)                                                                   \
+int hal_pin_##type##_new(const char *name, hal_pin_dir_t dir, hal_##type##_t **data_ptr_addr, \
+                         int comp_id) {                                                 \
+    (void)dir; (void)comp_id;                                                           \
+    return pin_new(name, (void **)data_ptr_addr, sizeof(hal_##type##_t));               \
+}                                                                                       \
+int hal_pin_##type##_newf(hal_pin_dir_t dir, hal_##type##_t **data_ptr_addr, int comp_id, \
+                          const char *fmt, ...) {                                       \
+    char name[HAL_NAME_LEN + 1];                                                        \
+    va_list ap;                                                                         \
+    va_start(ap, fmt);                                                                  \
+    vsnprintf(name, sizeof(name), fmt, ap);                                             \
+    va_end(ap);                                                                         \
+    return hal_pin_##type##_new(name, dir, data_ptr_addr, comp_id);                     \
+}
+
+PIN_NEW(bit)
+PIN_NEW(s32)
+PIN_NEW(u32)
+PIN_NEW(s64)
+PIN_NEW(u64)
+PIN_NEW(float)
+
+int hal_export_funct(const char *name, void (*funct)(void *, long), void *arg,
+                     int uses_fp, int reentrant, int comp_id) {
+    (void)uses_fp; (void)reentrant; (void)comp_id;
+    if (num_functs == STUB_MAX_FUNCTS) return -1;
+    snprintf(functs[num_functs].name, sizeof(functs[num_functs].name), "%s", name);
+    functs[num_functs].funct = funct;
+    functs[num_functs].arg = arg;
+    num_functs++;
+    return 0;
+}
+
+void *hal_stub_pin(const char *name) {
+    int i;
+
+    for (i = 0; i < num_pins; i++) {
+        if (strcmp(pins[i].name, name) == 0) return pins[i].ptr;
+    }
+    return NULL;
+}
+
+void (*hal_stub_funct(const char *name, void **arg))(void *, long) {
+    int i;
+
+    for (i = 0; i < num_functs; i++) {
+        if (strcmp(functs[i].name, name) == 0) {
+            *arg = functs[i].arg;
+            return functs[i].funct;
+        }
+    }
+    return NULL;
+}
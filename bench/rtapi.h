@@ -0,0 +1,31 @@
+/*
+ * rtapi.h - userspace stand-in for the bench harness
+ * Just enough RTAPI for hal_microkernel_bridge.c to build and run
+ * outside LinuxCNC. Not a replacement for the real header.
+ */
+
+#ifndef BENCH_RTAPI_H
+#define BENCH_RTAPI_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define RTAPI_MSG_NONE 0
+#define RTAPI_MSG_ERR  1
+#define RTAPI_MSG_WARN 2
+#define RTAPI_MSG_INFO 3
+#define RTAPI_MSG_DBG  4
+
+// Module metadata and parameters: the bench sets the variables directly
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define RTAPI_MP_INT(var, desc)
+#define RTAPI_MP_STRING(var, desc)
+#define RTAPI_MP_ARRAY_INT(var, num, desc)
+#define RTAPI_MP_ARRAY_STRING(var, num, desc)
+
+void rtapi_print_msg(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+long long rtapi_get_time(void);     // CLOCK_MONOTONIC ns, as in uspace
+
+#endif
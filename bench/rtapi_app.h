@@ -0,0 +1,11 @@
+/*
+ * rtapi_app.h - userspace stand-in for the bench harness
+ */
+
+#ifndef BENCH_RTAPI_APP_H
+#define BENCH_RTAPI_APP_H
+
+int rtapi_app_main(void);
+void rtapi_app_exit(void);
+
+#endif
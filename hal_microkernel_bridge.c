@@ -9,8 +9,21 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+// s64/u64 pins need LinuxCNC 2.9 or later; build with
+// -DMICROKERNEL_HAL_64=0 against older HAL headers
+#ifndef MICROKERNEL_HAL_64
+#define MICROKERNEL_HAL_64 1
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
 MODULE_AUTHOR("AILang + LinuxCNC");
 MODULE_DESCRIPTION("Bridge with Type Casting");
@@ -18,144 +31,1838 @@ MODULE_LICENSE("GPL");
 
 // Matches AILang Configuration
 #define MAX_PINS 256
-#define SHARED_MEM_PATH "/tmp/hal_pins.shm"
-#define SHARED_MEM_SIZE 4096
+#ifndef SHARED_MEM_PATH         // bench/ points it at a scratch file
+#define SHARED_MEM_PATH "/dev/shm/hal_pins"
+#endif
+#define SHARED_MEM_SIZE 131072
+#define SHM_LAYOUT_VERSION 18
+#define MAX_INSTANCES 8
+#define MAX_SAFE 16             // safe_slots= entries
+#define INTERP_MAX 8            // interp= channels
+#define SEQ_READ_TRIES 3
+#define FANOUT_DENSE_BITS 16    // Flagged slots per 64-slot word that switch to the block kernel
+#define REATTACH_POLL_NS 100000000  // How often the reattach thread checks for a new daemon
+#define RETIRED_MAX 4           // Old mappings kept per segment while an instance lags behind
+#define TIMING_EWMA_SHIFT 4     // Average execution time weights each call by 1/16
 
+// Shared memory layout, in int64 words (byte offset = word * 8).
+// Every 64-byte cache line has exactly one writer role - daemon, one
+// bridge instance, or one tool - so no two cores ever write into the
+// same line. Where a reader has to tell the writer what it consumed it
+// does so through an ack word in a line of its own, never by clearing
+// the writer's bits.
+#define SHM_PIN_COUNT    0      // Pin count (daemon)
+#define SHM_BACKING      1      // BACKING_PAGES / BACKING_HUGE (daemon)
+#define SHM_VERSION      2      // Layout version (daemon)
+#define SHM_GENERATION   3      // Daemon incarnation, written last at startup (0 = not ready)
+#define SHM_HEARTBEAT    4      // Bumped every daemon main loop iteration (daemon)
+#define SHM_BAND_EPOCH   5      // Bumped after each deadband table edit (daemon)
+#define SHM_MANIFEST_COUNT 6    // Named slots in the manifest, 0 = numbered pins (daemon)
+#define SHM_IN_ACK       8      // Per instance: INST_IN_SEQ of the last IN frame taken (daemon)
+#define SHM_OUT_DIRTY    16     // Bitmap: OUT slots changed since the owning instance's OUT ack (daemon)
+#define SHM_OUT_SEQ      32     // Seqlock over OUT values + OUT dirty (daemon)
+#define SHM_TYPES        64     // MAX_PINS type bytes, one per slot (daemon)
+#define SHM_IN_BASE      128    // HAL -> daemon values, MAX_PINS words (bridge, owning instance)
+#define SHM_OUT_BASE     384    // daemon -> HAL values, MAX_PINS words (daemon)
+#define SHM_SCALE        640    // MAX_PINS fixed-point scales for float slots (daemon)
+#define SHM_RING_HEAD    1024   // Sample ring: records written (bridge)
+#define SHM_RING_DROPPED 1025   // Records lost because the ring was full (bridge)
+#define SHM_RING_WIDTH   1026   // Slots per record, 0 = ring off (bridge, at load)
+#define SHM_RING_TAIL    1032   // Records consumed (daemon)
+#define SHM_RING_SLOTS   1040   // RING_WIDTH_MAX slot numbers, one per record column (bridge, at load)
+#define SHM_RING_BASE    1056   // RING_RECORDS x RING_RECORD_WORDS
+#define SHM_CMD_BASE     5152   // MAX_INSTANCES command rings, CMD_RING_WORDS each
+#define SHM_INTERP_BASE  7328   // INTERP_MAX setpoint rings, INTERP_WORDS each
+#define SHM_BAND_ABS     8192   // Per-slot IN deadband, absolute, in the slot's encoding (daemon)
+#define SHM_BAND_REL     8448   // Per-slot IN deadband, relative, parts per million (daemon)
+#define SHM_MANIFEST     8704   // Per slot MANIFEST_WORDS: pin name, direction (daemon, at registration)
+#define SHM_CAPTURE      10752  // Triggered capture: control, state, CAP_RECORDS buffer (see below)
+#define SHM_INSTANCES    14912  // MAX_INSTANCES x INST_WORDS (bridge, each instance its own entry)
+#define SHM_MAILBOX      15104  // MAILBOXES tool -> daemon OUT write queues (see below)
+#define SHM_OUT_WSEQ     15360  // Per slot: SHM_OUT_SEQ of the frame that last wrote its OUT value (daemon)
+#define DIRTY_WORDS      (MAX_PINS / 64)
+
+// Sample ring record: timestamp (ns), then the IN value of each sampled slot
+#define RING_WIDTH_MAX    15
+#define RING_RECORD_WORDS 16
+#define RING_RECORDS      256
+
+// Command ring, one per instance: the daemon queues OUT writes for a
+// target period, the instance applies them in its read. Entry: target,
+// slot, value, target kind.
+#define CMD_RING(k)       (SHM_CMD_BASE + CMD_RING_WORDS * (k))
+#define CMD_HEAD          0     // Entries queued (daemon)
+#define CMD_TAIL          8     // Entries consumed (bridge)
+#define CMD_LATE          9     // Entries applied after their target (bridge)
+#define CMD_MISSED        10    // Entries discarded: too late or bad slot (bridge)
+#define CMD_ENTRIES       16
+#define CMD_ENTRY_WORDS   4
+#define CMD_SIZE          64
+#define CMD_RING_WORDS    (CMD_ENTRIES + CMD_SIZE * CMD_ENTRY_WORDS)
+#define CMD_AT_TICK       0     // Target is the instance's update-count
+#define CMD_AT_TIME       1     // Target is an rtapi_get_time() timestamp (CLOCK_MONOTONIC ns)
+
+// Setpoint ring, one per interpolation channel: the daemon queues
+// (tick, value) points for one OUT slot, the owning instance consumes
+// them and interpolates between them every period. Values use the
+// slot's OUT encoding.
+#define INTERP(c)         (SHM_INTERP_BASE + INTERP_WORDS * (c))
+#define INTERP_HEAD       0     // Points queued (daemon)
+#define INTERP_MODE       1     // INTERP_LINEAR / INTERP_CUBIC (daemon)
+#define INTERP_TAIL       8     // Points consumed (bridge)
+#define INTERP_SLOT       9     // Slot this channel drives, -1 = unused (bridge, at load)
+#define INTERP_POINTS     16
+#define INTERP_SIZE       32
+#define INTERP_WORDS      (INTERP_POINTS + INTERP_SIZE * 2)
+#define INTERP_LINEAR     0
+#define INTERP_CUBIC      1     // Catmull-Rom through neighbouring points
+
+// Instance table entry: the slot range an instance owns, the seqlock
+// over its IN frame and its acks. One entry per instance because each
+// instance publishes from its own HAL thread, and a seqlock needs a
+// single writer. Two cache lines, both written only by that instance.
+#define SHM_INST(k)      (SHM_INSTANCES + INST_WORDS * (k))
+#define INST_WORDS       16
+#define INST_FIRST       0      // First slot
+#define INST_SLOTS       1      // Slot count (0 = entry unused)
+#define INST_IN_SEQ      2      // Seqlock over the instance's IN values + INST_IN_DIRTY
+#define INST_TICK        3      // Periods completed (update-count), the command ring's clock
+#define INST_OUT_ACK     4      // SHM_OUT_SEQ of the last OUT frame applied
+#define INST_IN_DIRTY    8      // DIRTY_WORDS bitmap: IN slots changed since SHM_IN_ACK
+
+// Tool mailbox: a tool queues OUT writes (slot, value) in its own
+// mailbox and the daemon applies them as ordinary OUT writes, so the
+// OUT lines keep the daemon as their only writer. One mailbox per tool
+// kind; run one copy of each tool at a time.
+#define MAILBOX(m)        (SHM_MAILBOX + MAILBOX_WORDS * (m))
+#define MAILBOXES         2     // MAILBOX_POKE, MAILBOX_STRESS
+#define MAILBOX_HEAD      0     // Entries queued (tool)
+#define MAILBOX_TAIL      8     // Entries applied (daemon)
+#define MAILBOX_ENTRIES   16    // MAILBOX_SIZE x (slot, value) (tool)
+#define MAILBOX_SIZE      32
+#define MAILBOX_WORDS     (MAILBOX_ENTRIES + MAILBOX_SIZE * 2)
+#define MAILBOX_POKE      0
+#define MAILBOX_STRESS    1
+
+// Manifest entry: NUL-terminated name (bytes 0-47), direction (byte 48)
+#define MANIFEST_WORDS    8
+#define MANIFEST_NAME_LEN 48
+#define MANIFEST_DIR      48
+#define MANIFEST_IN       1     // HAL -> daemon: <name>
+#define MANIFEST_OUT      2     // daemon -> HAL: <name>
+#define MANIFEST_IO       3     // Both: <name>.in and <name>.out
+
+// Triggered capture. A tool fills the control words and bumps CAP_ARM;
+// the instance owning the trigger slot then writes one record per
+// period into the buffer until post samples follow the trigger.
+// Column encoding: slot = IN value, CAP_OUT + slot = OUT value.
+#define CAP_ARM           0     // Bumped to arm with the words below (tool)
+#define CAP_WIDTH         1     // Columns per record, 1..CAP_WIDTH_MAX (tool)
+#define CAP_TRIG_SLOT     2     // Slot whose IN value is tested (tool)
+#define CAP_COND          3     // CAP_RISING / FALLING / CHANGE / NOW (tool)
+#define CAP_LEVEL         4     // Trigger level in the trigger slot's encoding (tool)
+#define CAP_PRE           5     // Records kept before the trigger (tool)
+#define CAP_POST          6     // Records taken after it (tool)
+#define CAP_COLS          8     // CAP_WIDTH_MAX column slots (tool)
+#define CAP_STATE         16    // CAP_IDLE / ARMED / TRIGGERED / DONE / ERROR (bridge)
+#define CAP_SEQ           17    // CAP_ARM value the state belongs to (bridge)
+#define CAP_FIRST         18    // Buffer index of the first record, once DONE (bridge)
+#define CAP_COUNT         19    // Records from CAP_FIRST, wrapping (bridge)
+#define CAP_TRIG_REC      20    // Trigger record's position from CAP_FIRST (bridge)
+#define CAP_BUFFER        32
+#define CAP_WIDTH_MAX     7
+#define CAP_RECORD_WORDS  8     // Timestamp (ns), then CAP_WIDTH values
+#define CAP_RECORDS       512
+#define CAP_OUT           256
+#define CAP_RISING        0
+#define CAP_FALLING       1
+#define CAP_CHANGE        2     // Any change of the raw value
+#define CAP_NOW           3     // First sample after arming
+#define CAP_IDLE          0
+#define CAP_ARMED         1
+#define CAP_TRIGGERED     2
+#define CAP_DONE          3
+#define CAP_ERROR         4     // Bad width, columns, or pre + post too long
+
+// Segment backing, matching SegmentBacking in the AILang sources. A
+// huge-page segment is a hugetlbfs file behind a symlink at the usual
+// path, and its file (and mapping) is one whole huge page.
+#define BACKING_PAGES    1      // Ordinary file, 4 KB pages
+#define BACKING_HUGE     2      // hugetlbfs file, one huge page
+
+// Slot types, matching PinTypes in the AILang sources
+#define SLOT_UNUSED      0
+#define SLOT_BIT         1
+#define SLOT_FLOAT       2
+#define SLOT_S32         3
+#define SLOT_U32         4
+#define SLOT_S64         5      // Full 64-bit slot (MICROKERNEL_HAL_64 only)
+#define SLOT_U64         6
+#define SLOT_ALL         255    // No type table: export bit, s32 and float
+
+// Each slot gets an IN and an OUT pin of its declared type. Without a
+// type table (daemon not running at load) we fall back to creating
+// bit, s32 and float pins so you can connect whatever type you need.
 typedef struct {
-    // We create three HAL pins for EACH shared memory slot
-    // enabling you to connect whatever type you need in HAL
-    hal_bit_t   *bit_in[MAX_PINS];
-    hal_bit_t   *bit_out[MAX_PINS];
-    
-    hal_s32_t   *s32_in[MAX_PINS];
-    hal_s32_t   *s32_out[MAX_PINS];
+    int          type;
+    double       scale;     // Float slots: 0 = IEEE-754 bits, else fixed-point units per 1.0
+    int          banded;    // Deadband set: IN changes within it are not published
+    double       band_abs;
+    double       band_rel;  // Fraction of the last published value
+
+    hal_bit_t   *bit_in;
+    hal_bit_t   *bit_out;
     
-    hal_float_t *float_in[MAX_PINS];
-    hal_float_t *float_out[MAX_PINS];
+    hal_s32_t   *s32_in;
+    hal_s32_t   *s32_out;
+
+    hal_u32_t   *u32_in;
+    hal_u32_t   *u32_out;
+
+#if MICROKERNEL_HAL_64
+    hal_s64_t   *s64_in;
+    hal_s64_t   *s64_out;
+
+    hal_u64_t   *u64_in;
+    hal_u64_t   *u64_out;
+#endif
     
+    hal_float_t *float_in;
+    hal_float_t *float_out;
+} hal_microkernel_slot_t;
+
+// Fan-out staging for one 64-slot block of OUT values: every
+// representation a pin might need, computed for the whole block at once
+typedef struct {
+    int32_t  lo[64];        // Low 32 bits (s32/u32 pins)
+    uint8_t  nz[64];        // Value != 0 (bit pins)
+    double   fx[64];        // Value / divisor (fixed-point float pins)
+} fanout_block_t;
+
+typedef void (*fanout_fn_t)(const int64_t *vals, const double *divisor, int n, fanout_block_t *out);
+
+typedef struct {
+    int64_t  tick;
+    double   value;
+} interp_point_t;
+
+// Bridge side of an interpolation channel: a window of up to four
+// points, pts[1]..pts[2] bracketing the current tick once it is full
+typedef struct {
+    int            index;       // Channel number in the segment
+    int            slot;        // Index into the instance's slot[]
+    int            n;
+    int            holding;     // Past the last point, holding its value
+    interp_point_t pts[4];
+} interp_channel_t;
+
+// An OUT slot forced to a fixed value while the daemon watchdog is tripped
+typedef struct {
+    int      slot;          // Index into the instance's slot[]
+    double   fval;          // Float slots
+    int64_t  ival;          // Every other type
+} safe_value_t;
+
+// Timing of one exported function, in ns from rtapi_get_time()
+enum { FN_READ, FN_WRITE, FN_UPDATE, FN_COUNT };
+
+typedef struct {
+    hal_s32_t   *time;          // Last execution time
+    hal_s32_t   *tmax;          // Largest execution time since load / reset-max
+    hal_s32_t   *tavg;          // Moving average execution time
+    hal_s32_t   *jitter;        // Last start-to-start interval minus the thread period
+    hal_s32_t   *jitter_max;    // Largest |jitter| since load / reset-max
+    long long    last_start;
+    long long    avg_sum;       // Average << TIMING_EWMA_SHIFT
+} fn_timing_t;
+
+// Capture configuration taken from the control words when armed
+typedef struct {
+    int      state;         // CAP_IDLE .. CAP_DONE, mirrored to CAP_STATE
+    int      width;
+    int      cols[CAP_WIDTH_MAX];
+    int      slot;          // Trigger slot, index into the instance's slot[]
+    int      cond;
+    double   level;
+    int      pre;
+    int      post;
+    int64_t  prev;          // Trigger slot's value one period ago
+    int64_t  n;             // Records written since arming
+    int64_t  trig;          // Record number of the trigger
+} capture_t;
+
+// A mapping replaced by a reattach, still in use by instances whose
+// attach is older than gone
+typedef struct {
+    volatile int64_t *ptr;
+    size_t len;
+    unsigned gone;                  // attach value that moved off it
+} retired_map_t;
+
+// One daemon's segment. The reattach thread replaces the mapping when
+// that daemon restarts: it maps the new segment, stores it in ptr, then
+// bumps attach. Each instance on the segment switches over at the start
+// of its next period, and an old mapping is unmapped only after all
+// of them have moved past it.
+typedef struct shm_segment {
+    const char *path;
+    volatile int64_t *ptr;          // Current mapping
+    size_t len;                     // Its length: the file size, a whole huge page on hugetlbfs
+    retired_map_t retired[RETIRED_MAX];
+    int num_retired;
+    unsigned attach;
+    ino_t ino;
+    int locked;
+    int current;                    // The mapped segment is still the one at path
+} shm_segment_t;
+
+// One bridge instance: a contiguous slot range with its own functions,
+// so each range can be sampled by a different HAL thread
+typedef struct {
+    char name[HAL_NAME_LEN + 1];    // Prefix for pins and functions
+    int index;                      // Entry in the shared instance table
+    int first;                      // First slot (global slot number)
+    int end;                        // One past the last slot
+    int first_word;                 // Dirty bitmap words covering the range
+    int end_word;
+    uint64_t own_mask[DIRTY_WORDS]; // Bits of each bitmap word this instance owns
+    hal_microkernel_slot_t *slot;   // Slot first+k at slot[k], in HAL shared memory
+    double *divisor;                // Per slot: fixed-point scale, or 1.0 (contiguous for SIMD)
+    int64_t *in_shadow;             // Per slot: last value published to IN (bridge-local)
+    int in_resync;                  // Publish every slot on the next write
+    uint64_t in_unacked[DIRTY_WORDS]; // IN slots published since the daemon's last IN ack
+    int64_t in_published;           // INST_IN_SEQ after our last IN frame
+    int out_resync;                 // Push every slot to the OUT pins on the next read
+    int64_t out_acked;              // SHM_OUT_SEQ of the last OUT frame applied
+    struct shm_segment *seg;        // Daemon segment this instance's slots live in
+    volatile int64_t *shm;          // Mapping this instance runs on
+    unsigned attach;                // seg->attach that shm belongs to (read by the reattach thread)
+
     hal_bit_t   *connected;
+    hal_bit_t   *mem_locked;
+    hal_u32_t   *generation;
+    hal_u32_t   *reattach_count;
     hal_u32_t   *update_count;
+    int          wrote;             // write_frame ran since the last read_frame
+    hal_u32_t   *seq_retries;
+    hal_bit_t   *reset_max;     // Set to clear tmax / jitter-max; the bridge clears it again
+    fn_timing_t  timing[FN_COUNT];
+    int          ring;          // This instance feeds the sample ring
+    hal_u32_t   *ring_dropped;
+    hal_u32_t   *cmd_applied;
+    hal_u32_t   *cmd_late;
+    hal_u32_t   *cmd_missed;
+    int64_t      last_heartbeat;
+    int          heartbeat_age;     // Periods since the daemon heartbeat last moved
+    int          tripped;
+    int          num_safe;
+    safe_value_t safe[MAX_SAFE];
+    hal_bit_t   *watchdog_tripped;
+    int64_t      band_epoch;        // SHM_BAND_EPOCH the slots' deadbands came from
+    int          num_interp;
+    interp_channel_t interp[INTERP_MAX];
+    hal_u32_t   *interp_underruns;
+    int64_t      cap_seen;          // Last CAP_ARM value looked at
+    capture_t    cap;
 } hal_microkernel_t;
 
-static hal_microkernel_t *hal_data = NULL;
+static char *names[MAX_INSTANCES] = { 0, };
+RTAPI_MP_ARRAY_STRING(names, MAX_INSTANCES, "Instance names (default: one instance, microkernel)");
+static int slots[MAX_INSTANCES] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+RTAPI_MP_ARRAY_INT(slots, MAX_INSTANCES, "Slots per instance, taken in consecutive ranges (last default: the rest)");
+static char *paths[MAX_INSTANCES] = { 0, };
+RTAPI_MP_ARRAY_STRING(paths, MAX_INSTANCES, "Daemon segment per instance (default: the previous instance's, first " SHARED_MEM_PATH ")");
+static int simd = 1;
+RTAPI_MP_INT(simd, "Use the AVX2/SSE4.2 fan-out kernel when the CPU has it (0 = scalar)");
+static int sample[RING_WIDTH_MAX] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+RTAPI_MP_ARRAY_INT(sample, RING_WIDTH_MAX, "Slots recorded into the sample ring every write (one instance's range)");
+static int watchdog = 0;
+RTAPI_MP_INT(watchdog, "Periods without a daemon heartbeat before safe_slots are forced (0 = off)");
+static int safe_slots[MAX_SAFE] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+RTAPI_MP_ARRAY_INT(safe_slots, MAX_SAFE, "OUT slots driven to safe_values while the watchdog is tripped");
+static char *safe_values[MAX_SAFE] = { 0, };
+RTAPI_MP_ARRAY_STRING(safe_values, MAX_SAFE, "Value for each of safe_slots (default 0)");
+static int interp[INTERP_MAX] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+RTAPI_MP_ARRAY_INT(interp, INTERP_MAX, "OUT slots driven by interpolating between queued setpoints");
+static int cmd_late_limit = -1;
+RTAPI_MP_INT(cmd_late_limit, "Discard queued commands more than this many periods late (-1 = always apply)");
+
+static hal_microkernel_t *instances[MAX_INSTANCES];
+static int num_instances;
 static int comp_id;
-static volatile int64_t *shm_ptr = NULL;
-static int shm_fd = -1;
+static int ring_width;
 
+static shm_segment_t segments[MAX_INSTANCES];
+static int num_segments;
+static pthread_t reattach_tid;
+static int reattach_running;
+static int reattach_stop;
+
+static void fanout_scalar(const int64_t *vals, const double *divisor, int n, fanout_block_t *out);
+static fanout_fn_t fanout = fanout_scalar;  // Chosen from CPUID at load
+static const char *fanout_name = "scalar";
+
+static void read_pins(void *arg, long period);
+static void write_pins(void *arg, long period);
 static void update_pins(void *arg, long period);
-static int map_shared_memory(void);
-static void unmap_shared_memory(void);
+static int export_instance(int index, const char *name, int first, int count, shm_segment_t *seg);
+static int export_slot_pins(const char *prefix, hal_microkernel_slot_t *slot, int i);
+static int export_named_pins(const char *prefix, hal_microkernel_slot_t *slot, int i,
+                             const volatile uint8_t *entry);
+static int export_timing_pins(const char *prefix, const char *fn, fn_timing_t *t);
+static int setup_ring(void);
+static int setup_safe(void);
+static int setup_interp(void);
+static void publish_interp(shm_segment_t *seg, volatile int64_t *ptr);
+static void publish_ring(shm_segment_t *seg, volatile int64_t *ptr);
+static void select_fanout(void);
+static shm_segment_t *find_segment(const char *path);
+static volatile int64_t *map_segment(const char *path, ino_t *ino, int *locked, size_t *len, int quiet);
+static void unmap_segment(volatile int64_t *ptr, size_t len);
+static void *reattach_thread(void *arg);
 
 int rtapi_app_main(void) {
-    int retval, i;
-    char name[HAL_NAME_LEN + 1];
+    int retval, k;
+    int first = 0;
+    int count;
+    const char *path = SHARED_MEM_PATH;
+    shm_segment_t *seg[MAX_INSTANCES];
 
     comp_id = hal_init("microkernel");
     if (comp_id < 0) return -1;
 
-    hal_data = hal_malloc(sizeof(hal_microkernel_t));
-    if (!hal_data) { hal_exit(comp_id); return -1; }
-    memset(hal_data, 0, sizeof(hal_microkernel_t));
+    num_instances = 0;
+    while (num_instances < MAX_INSTANCES && names[num_instances] && names[num_instances][0])
+        num_instances++;
+    if (num_instances == 0) num_instances = 1;
 
-    for (i = 0; i < MAX_PINS; i++) {
-        // --- BIT PINS (For BCD switches, Relays) ---
-        snprintf(name, sizeof(name), "microkernel.pin.%03d.in.bit", i);
-        if (hal_pin_bit_new(name, HAL_IN, &(hal_data->bit_in[i]), comp_id) != 0) return -1;
+    // Map first: each daemon's type table decides which pins exist
+    num_segments = 0;
+    for (k = 0; k < num_instances; k++) {
+        if (paths[k] && paths[k][0]) path = paths[k];
+        seg[k] = find_segment(path);
+        if (seg[k]->attach) continue;       // Shared with an earlier instance
+        seg[k]->ptr = map_segment(path, &seg[k]->ino, &seg[k]->locked, &seg[k]->len, 0);
+        seg[k]->current = (seg[k]->ptr != NULL);
+        seg[k]->attach = 1;
+        if (seg[k]->ptr) {
+            int j;
 
-        snprintf(name, sizeof(name), "microkernel.pin.%03d.out.bit", i);
-        if (hal_pin_bit_new(name, HAL_OUT, &(hal_data->bit_out[i]), comp_id) != 0) return -1;
+            for (j = 0; j < MAX_INSTANCES; j++) seg[k]->ptr[SHM_INST(j) + INST_SLOTS] = 0;
+        }
+    }
 
-        // --- S32 PINS (For Tool Numbers) ---
-        snprintf(name, sizeof(name), "microkernel.pin.%03d.in.s32", i);
-        if (hal_pin_s32_new(name, HAL_IN, &(hal_data->s32_in[i]), comp_id) != 0) return -1;
+    for (k = 0; k < num_instances; k++) {
+        count = slots[k];
+        if (count < 0) {
+            if (k != num_instances - 1) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: slots= needed for instance %d\n", k);
+                goto fail;
+            }
+            count = MAX_PINS - first;
+        }
+        if (count < 1 || first + count > MAX_PINS) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: instance %d slots=%d exceeds %d total\n",
+                            k, count, MAX_PINS);
+            goto fail;
+        }
+        // Eight slots fill a cache line; a shared line means two HAL threads writing it
+        if ((first & 7) && k > 0 && seg[k] == seg[k - 1]) {
+            rtapi_print_msg(RTAPI_MSG_WARN, "microkernel: instance %d starts at slot %d, IN values share a cache line with instance %d (use multiples of 8 in slots=)\n",
+                            k, first, k - 1);
+        }
+        retval = export_instance(k, names[k] ? names[k] : "microkernel", first, count, seg[k]);
+        if (retval != 0) goto fail;
+        first += count;
+    }
 
-        snprintf(name, sizeof(name), "microkernel.pin.%03d.out.s32", i);
-        if (hal_pin_s32_new(name, HAL_OUT, &(hal_data->s32_out[i]), comp_id) != 0) return -1;
-        
-        // --- FLOAT PINS (Optional, for Analog) ---
-        snprintf(name, sizeof(name), "microkernel.pin.%03d.in.float", i);
-        if (hal_pin_float_new(name, HAL_IN, &(hal_data->float_in[i]), comp_id) != 0) return -1;
-        
-        snprintf(name, sizeof(name), "microkernel.pin.%03d.out.float", i);
-        if (hal_pin_float_new(name, HAL_OUT, &(hal_data->float_out[i]), comp_id) != 0) return -1;
+    if (setup_ring() != 0) goto fail;
+    if (setup_safe() != 0) goto fail;
+    if (setup_interp() != 0) goto fail;
+    for (k = 0; k < num_segments; k++) {
+        if (!segments[k].ptr) continue;
+        publish_ring(&segments[k], segments[k].ptr);
+        publish_interp(&segments[k], segments[k].ptr);
     }
 
-    hal_pin_bit_new("microkernel.connected", HAL_OUT, &(hal_data->connected), comp_id);
-    hal_pin_u32_new("microkernel.update-count", HAL_OUT, &(hal_data->update_count), comp_id);
+    select_fanout();
 
-    if (map_shared_memory() != 0) *(hal_data->connected) = 0;
-    else *(hal_data->connected) = 1;
+    // Non-RT: follows daemon restarts so HAL does not have to be restarted
+    if (pthread_create(&reattach_tid, NULL, reattach_thread, NULL) == 0) {
+        reattach_running = 1;
+    } else {
+        rtapi_print_msg(RTAPI_MSG_WARN, "microkernel: no reattach thread, daemon restarts need a reload\n");
+    }
 
-    hal_export_funct("microkernel.update", update_pins, hal_data, 1, 0, comp_id);
     hal_ready(comp_id);
     return 0;
+
+fail:
+    for (k = 0; k < num_segments; k++) {
+        unmap_segment(segments[k].ptr, segments[k].len);
+        segments[k].ptr = NULL;
+    }
+    hal_exit(comp_id);
+    return -1;
+}
+
+// The segment table entry for path, added on first use
+static shm_segment_t *find_segment(const char *path) {
+    shm_segment_t *seg;
+    int k;
+
+    for (k = 0; k < num_segments; k++) {
+        if (strcmp(segments[k].path, path) == 0) return &segments[k];
+    }
+    seg = &segments[num_segments++];
+    memset(seg, 0, sizeof(*seg));
+    seg->path = path;
+    return seg;
 }
 
-static int map_shared_memory(void) {
-    shm_fd = open(SHARED_MEM_PATH, O_RDWR);
-    if (shm_fd < 0) return -1;
+static int export_instance(int index, const char *name, int first, int count, shm_segment_t *seg) {
+    hal_microkernel_t *data;
+    char fname[HAL_NAME_LEN + 1];
+    volatile int64_t *shm = seg->ptr;
+    int connected = (shm != NULL);
+    int retval, i;
+
+    data = hal_malloc(sizeof(hal_microkernel_t));
+    if (!data) return -1;
+    memset(data, 0, sizeof(hal_microkernel_t));
+
+    snprintf(data->name, sizeof(data->name), "%s", name);
+    data->index = index;
+    data->first = first;
+    data->end = first + count;
+    data->first_word = first >> 6;
+    data->end_word = (data->end + 63) >> 6;
+    for (i = first; i < data->end; i++) data->own_mask[i >> 6] |= 1ULL << (i & 63);
+    data->in_resync = 1;
+    data->in_published = -1;
+    data->out_resync = 1;
+    data->out_acked = -1;
+    data->seg = seg;
+    data->shm = shm;
+    data->attach = seg->attach;
+    data->band_epoch = -1;
+    data->cap_seen = connected ? shm[SHM_CAPTURE + CAP_ARM] : 0;
+
+    data->slot = hal_malloc(count * sizeof(hal_microkernel_slot_t));
+    if (!data->slot) return -1;
+    memset(data->slot, 0, count * sizeof(hal_microkernel_slot_t));
+    data->divisor = hal_malloc(count * sizeof(double));
+    if (!data->divisor) return -1;
+    data->in_shadow = hal_malloc(count * sizeof(int64_t));
+    if (!data->in_shadow) return -1;
+
+    for (i = first; i < data->end; i++) {
+        hal_microkernel_slot_t *slot = &data->slot[i - first];
+
+        slot->type = connected ? ((volatile uint8_t *)&shm[SHM_TYPES])[i] : SLOT_ALL;
+        slot->scale = connected ? (double)shm[SHM_SCALE + i] : 0.0;
+        data->divisor[i - first] = (slot->scale != 0.0) ? slot->scale : 1.0;
+        if (connected && shm[SHM_MANIFEST_COUNT] > 0) {
+            retval = export_named_pins(name, slot, i,
+                                       (const volatile uint8_t *)&shm[SHM_MANIFEST + i * MANIFEST_WORDS]);
+        } else {
+            retval = export_slot_pins(name, slot, i);
+        }
+        if (retval != 0) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: pin export failed for slot %d\n", i);
+            return retval;
+        }
+    }
+
+    retval = hal_pin_bit_newf(HAL_OUT, &(data->connected), comp_id, "%s.connected", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_bit_newf(HAL_OUT, &(data->mem_locked), comp_id, "%s.mem-locked", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_u32_newf(HAL_OUT, &(data->generation), comp_id, "%s.generation", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_u32_newf(HAL_OUT, &(data->reattach_count), comp_id, "%s.reattach-count", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_u32_newf(HAL_OUT, &(data->update_count), comp_id, "%s.update-count", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_u32_newf(HAL_OUT, &(data->seq_retries), comp_id, "%s.seq-retries", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_u32_newf(HAL_OUT, &(data->cmd_applied), comp_id, "%s.cmd-applied", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_u32_newf(HAL_OUT, &(data->cmd_late), comp_id, "%s.cmd-late", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_u32_newf(HAL_OUT, &(data->cmd_missed), comp_id, "%s.cmd-missed", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_bit_newf(HAL_OUT, &(data->watchdog_tripped), comp_id, "%s.watchdog-tripped", name);
+    if (retval != 0) return retval;
+    retval = hal_pin_bit_newf(HAL_IO, &(data->reset_max), comp_id, "%s.reset-max", name);
+    if (retval != 0) return retval;
+    retval = export_timing_pins(name, "read", &data->timing[FN_READ]);
+    if (retval != 0) return retval;
+    retval = export_timing_pins(name, "write", &data->timing[FN_WRITE]);
+    if (retval != 0) return retval;
+    retval = export_timing_pins(name, "update", &data->timing[FN_UPDATE]);
+    if (retval != 0) return retval;
+
+    *(data->connected) = connected;
+    *(data->mem_locked) = seg->locked;
+    *(data->generation) = connected ? (hal_u32_t)shm[SHM_GENERATION] : 0;
+
+    // Publish the range so the daemon knows which IN seqlock covers a slot
+    if (connected) {
+        shm[SHM_INST(index) + INST_FIRST] = first;
+        shm[SHM_INST(index) + INST_SLOTS] = count;
+    }
+
+    snprintf(fname, sizeof(fname), "%s.read", name);
+    retval = hal_export_funct(fname, read_pins, data, 1, 0, comp_id);
+    if (retval != 0) return retval;
+    snprintf(fname, sizeof(fname), "%s.write", name);
+    retval = hal_export_funct(fname, write_pins, data, 1, 0, comp_id);
+    if (retval != 0) return retval;
+    snprintf(fname, sizeof(fname), "%s.update", name);
+    retval = hal_export_funct(fname, update_pins, data, 1, 0, comp_id);
+    if (retval != 0) return retval;
+
+    instances[index] = data;
+    return 0;
+}
+
+// Float slots carry the double's bit pattern, so nothing is lost in transit
+typedef union {
+    double  f;
+    int64_t i;
+} slot_value_t;
+
+static int export_slot_pins(const char *prefix, hal_microkernel_slot_t *slot, int i) {
+    char name[HAL_NAME_LEN + 1];
+    int type = slot->type;
+
+    // --- BIT PINS (For BCD switches, Relays) ---
+    if (type == SLOT_BIT || type == SLOT_ALL) {
+        snprintf(name, sizeof(name), "%s.pin.%03d.in.bit", prefix, i);
+        if (hal_pin_bit_new(name, HAL_IN, &(slot->bit_in), comp_id) != 0) return -1;
+
+        snprintf(name, sizeof(name), "%s.pin.%03d.out.bit", prefix, i);
+        if (hal_pin_bit_new(name, HAL_OUT, &(slot->bit_out), comp_id) != 0) return -1;
+    }
+
+    // --- S32 PINS (For Tool Numbers) ---
+    if (type == SLOT_S32 || type == SLOT_ALL) {
+        snprintf(name, sizeof(name), "%s.pin.%03d.in.s32", prefix, i);
+        if (hal_pin_s32_new(name, HAL_IN, &(slot->s32_in), comp_id) != 0) return -1;
+
+        snprintf(name, sizeof(name), "%s.pin.%03d.out.s32", prefix, i);
+        if (hal_pin_s32_new(name, HAL_OUT, &(slot->s32_out), comp_id) != 0) return -1;
+    }
+
+    // --- U32 PINS (For Counters) ---
+    if (type == SLOT_U32) {
+        snprintf(name, sizeof(name), "%s.pin.%03d.in.u32", prefix, i);
+        if (hal_pin_u32_new(name, HAL_IN, &(slot->u32_in), comp_id) != 0) return -1;
+
+        snprintf(name, sizeof(name), "%s.pin.%03d.out.u32", prefix, i);
+        if (hal_pin_u32_new(name, HAL_OUT, &(slot->u32_out), comp_id) != 0) return -1;
+    }
     
-    shm_ptr = (volatile int64_t *)mmap(NULL, SHARED_MEM_SIZE, 
-                                       PROT_READ | PROT_WRITE, 
-                                       MAP_SHARED, shm_fd, 0);
-    if (shm_ptr == MAP_FAILED) { close(shm_fd); return -1; }
+#if MICROKERNEL_HAL_64
+    // --- S64 / U64 PINS (For Encoders, Wide Counters) ---
+    if (type == SLOT_S64) {
+        snprintf(name, sizeof(name), "%s.pin.%03d.in.s64", prefix, i);
+        if (hal_pin_s64_new(name, HAL_IN, &(slot->s64_in), comp_id) != 0) return -1;
+
+        snprintf(name, sizeof(name), "%s.pin.%03d.out.s64", prefix, i);
+        if (hal_pin_s64_new(name, HAL_OUT, &(slot->s64_out), comp_id) != 0) return -1;
+    }
+
+    if (type == SLOT_U64) {
+        snprintf(name, sizeof(name), "%s.pin.%03d.in.u64", prefix, i);
+        if (hal_pin_u64_new(name, HAL_IN, &(slot->u64_in), comp_id) != 0) return -1;
+
+        snprintf(name, sizeof(name), "%s.pin.%03d.out.u64", prefix, i);
+        if (hal_pin_u64_new(name, HAL_OUT, &(slot->u64_out), comp_id) != 0) return -1;
+    }
+#else
+    if (type == SLOT_S64 || type == SLOT_U64) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: slot %d is 64-bit, built without MICROKERNEL_HAL_64\n", i);
+        return -1;
+    }
+#endif
+
+    // --- FLOAT PINS (For Analog) ---
+    if (type == SLOT_FLOAT || type == SLOT_ALL) {
+        snprintf(name, sizeof(name), "%s.pin.%03d.in.float", prefix, i);
+        if (hal_pin_float_new(name, HAL_IN, &(slot->float_in), comp_id) != 0) return -1;
+        
+        snprintf(name, sizeof(name), "%s.pin.%03d.out.float", prefix, i);
+        if (hal_pin_float_new(name, HAL_OUT, &(slot->float_out), comp_id) != 0) return -1;
+    }
+
+    // SLOT_UNUSED and unknown codes export nothing
     return 0;
 }
 
-static void unmap_shared_memory(void) {
-    if (shm_ptr) munmap((void *)shm_ptr, SHARED_MEM_SIZE);
-    if (shm_fd >= 0) close(shm_fd);
+// Stand-ins for the pins a manifest slot does not export, so the
+// per-period paths need no direction checks: reads see 0, writes land
+// in a sink nobody reads
+typedef union {
+    hal_bit_t   b;
+    hal_s32_t   s;
+    hal_u32_t   u;
+#if MICROKERNEL_HAL_64
+    hal_s64_t   s64;
+    hal_u64_t   u64;
+#endif
+    hal_float_t f;
+} pin_stub_t;
+
+static pin_stub_t *stub_in, *stub_out;
+
+// One pin of the slot's type in direction dir, or the stand-in when
+// name is NULL
+static int slot_pin_new(hal_microkernel_slot_t *slot, hal_pin_dir_t dir, const char *name) {
+    pin_stub_t *stub = (dir == HAL_IN) ? stub_in : stub_out;
+
+    switch (slot->type) {
+    case SLOT_BIT:
+        if (!name) { *(dir == HAL_IN ? &slot->bit_in : &slot->bit_out) = &stub->b; return 0; }
+        return hal_pin_bit_new(name, dir, dir == HAL_IN ? &slot->bit_in : &slot->bit_out, comp_id);
+    case SLOT_S32:
+        if (!name) { *(dir == HAL_IN ? &slot->s32_in : &slot->s32_out) = &stub->s; return 0; }
+        return hal_pin_s32_new(name, dir, dir == HAL_IN ? &slot->s32_in : &slot->s32_out, comp_id);
+    case SLOT_U32:
+        if (!name) { *(dir == HAL_IN ? &slot->u32_in : &slot->u32_out) = &stub->u; return 0; }
+        return hal_pin_u32_new(name, dir, dir == HAL_IN ? &slot->u32_in : &slot->u32_out, comp_id);
+#if MICROKERNEL_HAL_64
+    case SLOT_S64:
+        if (!name) { *(dir == HAL_IN ? &slot->s64_in : &slot->s64_out) = &stub->s64; return 0; }
+        return hal_pin_s64_new(name, dir, dir == HAL_IN ? &slot->s64_in : &slot->s64_out, comp_id);
+    case SLOT_U64:
+        if (!name) { *(dir == HAL_IN ? &slot->u64_in : &slot->u64_out) = &stub->u64; return 0; }
+        return hal_pin_u64_new(name, dir, dir == HAL_IN ? &slot->u64_in : &slot->u64_out, comp_id);
+#endif
+    case SLOT_FLOAT:
+        if (!name) { *(dir == HAL_IN ? &slot->float_in : &slot->float_out) = &stub->f; return 0; }
+        return hal_pin_float_new(name, dir, dir == HAL_IN ? &slot->float_in : &slot->float_out, comp_id);
+    default:
+        return -1;
+    }
 }
 
-static void update_pins(void *arg, long period) {
-    hal_microkernel_t *data = (hal_microkernel_t *)arg;
+// Manifest export: only the directions the daemon declared, under the
+// daemon's name for the slot. Slots without a name export nothing.
+// <prefix>.<label><suffix>. A cut-off name could collide with another
+// label's, so a name that does not fit fails the load instead.
+static int named_pin_name(char *name, size_t size, const char *prefix, const char *label,
+                          const char *suffix, int i) {
+    int len = snprintf(name, size, "%s.%s%s", prefix, label, suffix);
+
+    if (len < 0 || (size_t)len >= size) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: slot %d label \"%s\": pin %s.%s%s is longer than %d characters\n",
+                        i, label, prefix, label, suffix, (int)size - 1);
+        return -1;
+    }
+    return 0;
+}
+
+static int export_named_pins(const char *prefix, hal_microkernel_slot_t *slot, int i,
+                             const volatile uint8_t *entry) {
+    char label[MANIFEST_NAME_LEN];
+    char name[HAL_NAME_LEN + 1];
+    int dir = entry[MANIFEST_DIR];
+    int n;
+
+    for (n = 0; n < MANIFEST_NAME_LEN - 1 && entry[n]; n++) label[n] = entry[n];
+    label[n] = 0;
+    if (n == 0 || slot->type == SLOT_UNUSED) {
+        slot->type = SLOT_UNUSED;
+        return 0;
+    }
+
+    if (!stub_in) {
+        stub_in = hal_malloc(sizeof(pin_stub_t));
+        stub_out = hal_malloc(sizeof(pin_stub_t));
+        if (!stub_in || !stub_out) return -1;
+        memset(stub_in, 0, sizeof(pin_stub_t));
+    }
+
+    if (dir == MANIFEST_IO) {
+        if (named_pin_name(name, sizeof(name), prefix, label, ".in", i) != 0) return -1;
+        if (slot_pin_new(slot, HAL_IN, name) != 0) return -1;
+        if (named_pin_name(name, sizeof(name), prefix, label, ".out", i) != 0) return -1;
+        return slot_pin_new(slot, HAL_OUT, name);
+    }
+    if (named_pin_name(name, sizeof(name), prefix, label, "", i) != 0) return -1;
+    if (dir == MANIFEST_IN) {
+        if (slot_pin_new(slot, HAL_IN, name) != 0) return -1;
+        return slot_pin_new(slot, HAL_OUT, NULL);
+    }
+    if (dir == MANIFEST_OUT) {
+        if (slot_pin_new(slot, HAL_IN, NULL) != 0) return -1;
+        return slot_pin_new(slot, HAL_OUT, name);
+    }
+    rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: slot %d (%s) has direction %d\n", i, label, dir);
+    return -1;
+}
+
+// sample= picks the ring's columns. An SPSC ring needs a single producer,
+// so every sampled slot must belong to the same instance, which then
+// appends one record per write.
+static int setup_ring(void) {
+    hal_microkernel_t *owner = NULL;
+    int c, k;
+
+    for (ring_width = 0; ring_width < RING_WIDTH_MAX && sample[ring_width] >= 0; ring_width++) {
+        for (k = 0; k < num_instances; k++) {
+            if (sample[ring_width] >= instances[k]->first && sample[ring_width] < instances[k]->end) break;
+        }
+        if (k == num_instances || (owner && owner != instances[k])) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: sample slot %d is not in the first sampled slot's instance\n",
+                            sample[ring_width]);
+            return -1;
+        }
+        owner = instances[k];
+    }
+    if (!owner) return 0;
+
+    owner->ring = 1;
+    for (c = 0; c < ring_width; c++) {
+        if (owner->slot[sample[c] - owner->first].type == SLOT_UNUSED) {
+            rtapi_print_msg(RTAPI_MSG_WARN, "microkernel: sample slot %d is unused\n", sample[c]);
+        }
+    }
+    return hal_pin_u32_newf(HAL_OUT, &(owner->ring_dropped), comp_id, "%s.ring-dropped", owner->name);
+}
+
+// Hand each safe_slots= entry to the instance that owns the slot
+static int setup_safe(void) {
+    hal_microkernel_t *data;
+    safe_value_t *sv;
+    const char *text;
+    char *end;
+    int n, k, fp;
+
+    for (n = 0; n < MAX_SAFE && safe_slots[n] >= 0; n++) {
+        for (k = 0; k < num_instances; k++) {
+            if (safe_slots[n] >= instances[k]->first && safe_slots[n] < instances[k]->end) break;
+        }
+        if (k == num_instances) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: safe slot %d is not exported\n", safe_slots[n]);
+            return -1;
+        }
+        data = instances[k];
+        text = (safe_values[n] && safe_values[n][0]) ? safe_values[n] : "0";
+        sv = &data->safe[data->num_safe];
+        sv->slot = safe_slots[n] - data->first;
+        // Float slots take decimals, every other type a whole integer
+        fp = (data->slot[sv->slot].type == SLOT_FLOAT || data->slot[sv->slot].type == SLOT_ALL);
+        errno = 0;
+        if (fp) sv->fval = strtod(text, &end);
+        else sv->ival = strtoll(text, &end, 0);
+        // SLOT_ALL drives bit and s32 from the same number, so it must fit an int64
+        if (end == text || *end != '\0' || errno != 0
+            || (data->slot[sv->slot].type == SLOT_ALL
+                && !(sv->fval >= -9223372036854775808.0 && sv->fval < 9223372036854775808.0))) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: safe value \"%s\" for slot %d is not %s\n",
+                            text, safe_slots[n], fp ? "a number in range" : "an integer in range");
+            return -1;
+        }
+        if (data->slot[sv->slot].type == SLOT_ALL) sv->ival = (int64_t)sv->fval;
+        data->num_safe++;
+    }
+    if (n > 0 && watchdog <= 0) {
+        rtapi_print_msg(RTAPI_MSG_WARN, "microkernel: safe_slots set but watchdog=0, they are never used\n");
+    }
+    return 0;
+}
+
+// interp= channels go to the instance owning each slot; numbered in
+// modparam order, which is how the daemon finds them in the segment
+static int setup_interp(void) {
+    hal_microkernel_t *data;
+    interp_channel_t *ch;
+    int c, k, type;
+
+    for (c = 0; c < INTERP_MAX && interp[c] >= 0; c++) {
+        for (k = 0; k < num_instances; k++) {
+            if (interp[c] >= instances[k]->first && interp[c] < instances[k]->end) break;
+        }
+        if (k == num_instances) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: interp slot %d is not exported\n", interp[c]);
+            return -1;
+        }
+        data = instances[k];
+        // SLOT_ALL (no type table at load) does not say how OUT is encoded
+        type = data->slot[interp[c] - data->first].type;
+        if (type != SLOT_FLOAT) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: interp slot %d is not a float slot%s\n", interp[c],
+                            type == SLOT_ALL ? " (daemon not running at load)" : "");
+            return -1;
+        }
+        ch = &data->interp[data->num_interp++];
+        ch->index = c;
+        ch->slot = interp[c] - data->first;
+        if (!data->interp_underruns &&
+            hal_pin_u32_newf(HAL_OUT, &(data->interp_underruns), comp_id, "%s.interp-underruns", data->name) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Channels driven by an instance on another segment stay unused here
+static void publish_interp(shm_segment_t *seg, volatile int64_t *ptr) {
+    int c, k;
+
+    for (c = 0; c < INTERP_MAX; c++) ptr[INTERP(c) + INTERP_SLOT] = -1;
+    for (k = 0; k < num_instances; k++) {
+        hal_microkernel_t *data = instances[k];
+
+        if (data->seg != seg) continue;
+        for (c = 0; c < data->num_interp; c++) {
+            ptr[INTERP(data->interp[c].index) + INTERP_SLOT] = data->first + data->interp[c].slot;
+        }
+    }
+}
+
+// The daemon reads the record format from the segment
+// The ring lives in the segment of the instance that feeds it
+static void publish_ring(shm_segment_t *seg, volatile int64_t *ptr) {
+    int c, k;
+
+    ptr[SHM_RING_WIDTH] = 0;
+    for (k = 0; k < num_instances; k++) {
+        if (!instances[k]->ring || instances[k]->seg != seg) continue;
+        ptr[SHM_RING_WIDTH] = ring_width;
+        for (c = 0; c < ring_width; c++) ptr[SHM_RING_SLOTS + c] = sample[c];
+    }
+}
+
+static int export_timing_pins(const char *prefix, const char *fn, fn_timing_t *t) {
+    if (hal_pin_s32_newf(HAL_OUT, &(t->time), comp_id, "%s.%s.time", prefix, fn) != 0) return -1;
+    if (hal_pin_s32_newf(HAL_OUT, &(t->tmax), comp_id, "%s.%s.tmax", prefix, fn) != 0) return -1;
+    if (hal_pin_s32_newf(HAL_OUT, &(t->tavg), comp_id, "%s.%s.tavg", prefix, fn) != 0) return -1;
+    if (hal_pin_s32_newf(HAL_OUT, &(t->jitter), comp_id, "%s.%s.jitter", prefix, fn) != 0) return -1;
+    if (hal_pin_s32_newf(HAL_OUT, &(t->jitter_max), comp_id, "%s.%s.jitter-max", prefix, fn) != 0) return -1;
+    return 0;
+}
+
+static inline int64_t float_to_slot(const hal_microkernel_slot_t *slot, double f) {
+    slot_value_t v;
+
+    if (slot->scale != 0.0) {
+        // Fixed point for integer-only consumers, rounded half away from zero
+        f *= slot->scale;
+        return (int64_t)(f >= 0.0 ? f + 0.5 : f - 0.5);
+    }
+    v.f = f;
+    return v.i;
+}
+
+static inline double slot_to_float(const hal_microkernel_slot_t *slot, int64_t raw) {
+    slot_value_t v;
+
+    if (slot->scale != 0.0) return (double)raw / slot->scale;
+    v.i = raw;
+    return v.f;
+}
+
+// HAL -> slot value for one slot, converting only the declared type
+static inline int64_t sample_in_pin(const hal_microkernel_slot_t *slot) {
+    int64_t val = 0;
+
+    switch (slot->type) {
+    case SLOT_BIT:   return *(slot->bit_in) ? 1 : 0;
+    case SLOT_S32:   return *(slot->s32_in);
+    case SLOT_U32:   return *(slot->u32_in);
+#if MICROKERNEL_HAL_64
+    case SLOT_S64:   return *(slot->s64_in);
+    case SLOT_U64:   return (int64_t)*(slot->u64_in);
+#endif
+    case SLOT_FLOAT: return float_to_slot(slot, *(slot->float_in));
+    case SLOT_ALL:
+        // Priority logic: S32 > Bit
+        // Typically user only connects one type per index.
+        if (*(slot->bit_in)) val = 1;
+        if (*(slot->s32_in) != 0) val = *(slot->s32_in);
+        return val;
+    default:         return 0;
+    }
+}
+
+// Slot value -> HAL for one slot
+static inline void drive_out_pin(const hal_microkernel_slot_t *slot, int64_t val) {
+    switch (slot->type) {
+    case SLOT_BIT:   *(slot->bit_out)   = (val != 0);         break;
+    case SLOT_S32:   *(slot->s32_out)   = (hal_s32_t)val;     break;
+    case SLOT_U32:   *(slot->u32_out)   = (hal_u32_t)val;     break;
+#if MICROKERNEL_HAL_64
+    case SLOT_S64:   *(slot->s64_out)   = val;                break;
+    case SLOT_U64:   *(slot->u64_out)   = (uint64_t)val;      break;
+#endif
+    case SLOT_FLOAT: *(slot->float_out) = slot_to_float(slot, val); break;
+    case SLOT_ALL:
+        // Broadcast value to all types
+        *(slot->bit_out)   = (val != 0);
+        *(slot->s32_out)   = (hal_s32_t)val;
+        *(slot->float_out) = (hal_float_t)val;
+        break;
+    default: break;
+    }
+}
+
+// Slot value -> HAL for one slot, from a block the fan-out kernel converted
+static inline void drive_out_staged(const hal_microkernel_slot_t *slot,
+                                    const fanout_block_t *blk, int j, int64_t val) {
+    switch (slot->type) {
+    case SLOT_BIT:   *(slot->bit_out) = blk->nz[j];            break;
+    case SLOT_S32:   *(slot->s32_out) = blk->lo[j];            break;
+    case SLOT_U32:   *(slot->u32_out) = (uint32_t)blk->lo[j];  break;
+#if MICROKERNEL_HAL_64
+    case SLOT_S64:   *(slot->s64_out) = val;                   break;
+    case SLOT_U64:   *(slot->u64_out) = (uint64_t)val;         break;
+#endif
+    case SLOT_FLOAT:
+        if (slot->scale != 0.0) *(slot->float_out) = blk->fx[j];
+        else *(slot->float_out) = slot_to_float(slot, val);
+        break;
+    case SLOT_ALL:
+        // Divisor is 1.0 here, so fx is the plain int64 -> double
+        *(slot->bit_out)   = blk->nz[j];
+        *(slot->s32_out)   = blk->lo[j];
+        *(slot->float_out) = blk->fx[j];
+        break;
+    default: break;
+    }
+}
+
+/*
+ * Fan-out kernels: convert n consecutive OUT values to all pin
+ * representations in one pass (compare-to-zero mask, narrowing to 32
+ * bits, int64 -> double / divisor). Only used when a 64-slot word has
+ * at least FANOUT_DENSE_BITS flagged slots, or on a full resync; sparse
+ * updates stay on the per-slot path.
+ */
+static inline void fanout_range(const int64_t *vals, const double *divisor,
+                                int j, int n, fanout_block_t *out) {
+    for (; j < n; j++) {
+        out->nz[j] = (vals[j] != 0);
+        out->lo[j] = (int32_t)vals[j];
+        out->fx[j] = (double)vals[j] / divisor[j];
+    }
+}
+
+static void fanout_scalar(const int64_t *vals, const double *divisor, int n, fanout_block_t *out) {
+    fanout_range(vals, divisor, 0, n, out);
+}
+
+#ifdef HAVE_X86_SIMD
+// Exact signed int64 -> double without AVX-512: split into 32-bit halves
+// planted in the mantissas of 2^84+2^63 and 2^52, subtract the bias, add.
+__attribute__((target("avx2")))
+static inline __m256d cvt_epi64_pd_avx2(__m256i v) {
+    const __m256i lo_magic = _mm256_set1_epi64x(0x4330000000000000LL);
+    const __m256i hi_magic = _mm256_set1_epi64x(0x4530000080000000LL);
+    const __m256d all_magic = _mm256_castsi256_pd(_mm256_set1_epi64x(0x4530000080100000LL));
+    __m256i lo = _mm256_blend_epi32(lo_magic, v, 0x55);
+    __m256i hi = _mm256_xor_si256(_mm256_srli_epi64(v, 32), hi_magic);
+    __m256d hi_d = _mm256_sub_pd(_mm256_castsi256_pd(hi), all_magic);
+    return _mm256_add_pd(hi_d, _mm256_castsi256_pd(lo));
+}
+
+__attribute__((target("avx2")))
+static void fanout_avx2(const int64_t *vals, const double *divisor, int n, fanout_block_t *out) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i low_lanes = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    int j, k;
+
+    for (j = 0; j + 4 <= n; j += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&vals[j]);
+        int zmask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, zero)));
+        __m256i packed = _mm256_permutevar8x32_epi32(v, low_lanes);
+
+        _mm_storeu_si128((__m128i *)&out->lo[j], _mm256_castsi256_si128(packed));
+        _mm256_storeu_pd(&out->fx[j], _mm256_div_pd(cvt_epi64_pd_avx2(v),
+                                                    _mm256_loadu_pd(&divisor[j])));
+        for (k = 0; k < 4; k++) out->nz[j + k] = !((zmask >> k) & 1);
+    }
+    fanout_range(vals, divisor, j, n, out);
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128d cvt_epi64_pd_sse(__m128i v) {
+    const __m128i lo_magic = _mm_set1_epi64x(0x4330000000000000LL);
+    const __m128i hi_magic = _mm_set1_epi64x(0x4530000080000000LL);
+    const __m128d all_magic = _mm_castsi128_pd(_mm_set1_epi64x(0x4530000080100000LL));
+    __m128i lo = _mm_blend_epi16(lo_magic, v, 0x33);
+    __m128i hi = _mm_xor_si128(_mm_srli_epi64(v, 32), hi_magic);
+    __m128d hi_d = _mm_sub_pd(_mm_castsi128_pd(hi), all_magic);
+    return _mm_add_pd(hi_d, _mm_castsi128_pd(lo));
+}
+
+__attribute__((target("sse4.2")))
+static void fanout_sse42(const int64_t *vals, const double *divisor, int n, fanout_block_t *out) {
+    const __m128i zero = _mm_setzero_si128();
+    int j;
+
+    for (j = 0; j + 2 <= n; j += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&vals[j]);
+        int zmask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v, zero)));
+        __m128i packed = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0));
+
+        _mm_storel_epi64((__m128i *)&out->lo[j], packed);
+        _mm_storeu_pd(&out->fx[j], _mm_div_pd(cvt_epi64_pd_sse(v), _mm_loadu_pd(&divisor[j])));
+        out->nz[j]     = !(zmask & 1);
+        out->nz[j + 1] = !(zmask & 2);
+    }
+    fanout_range(vals, divisor, j, n, out);
+}
+#endif
+
+static void select_fanout(void) {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (simd && __builtin_cpu_supports("avx2")) {
+        fanout = fanout_avx2;
+        fanout_name = "avx2";
+    } else if (simd && __builtin_cpu_supports("sse4.2")) {
+        fanout = fanout_sse42;
+        fanout_name = "sse4.2";
+    }
+#endif
+    rtapi_print_msg(RTAPI_MSG_INFO, "microkernel: %s fan-out kernel\n", fanout_name);
+}
+
+// Map the daemon's segment, prefaulted and locked. The fd is closed
+// again right away; the mapping keeps the inode alive even after a
+// restarted daemon unlinks the path. quiet: the reattach thread polls
+// with this while a new daemon may still be starting up.
+static volatile int64_t *map_segment(const char *path, ino_t *ino, int *locked, size_t *len, int quiet) {
+    volatile int64_t *ptr;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDWR);
+    if (fd < 0) return NULL;
+
+    // A segment from an older daemon is too small; touching past EOF would SIGBUS
+    if (fstat(fd, &st) != 0 || st.st_size < SHARED_MEM_SIZE) {
+        if (!quiet) rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: %s is not a v%d segment\n",
+                                    path, SHM_LAYOUT_VERSION);
+        close(fd);
+        return NULL;
+    }
+    
+    // Prefault and lock the pages here, so the first access from the
+    // servo thread cannot take a page fault. Map the whole file: on
+    // hugetlbfs that is one huge page, and a shorter mapping could not
+    // be unmapped again.
+    ptr = (volatile int64_t *)mmap(NULL, st.st_size, 
+                                   PROT_READ | PROT_WRITE, 
+                                   MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return NULL;
+
+    if (ptr[SHM_VERSION] != SHM_LAYOUT_VERSION || ptr[SHM_GENERATION] == 0) {
+        if (!quiet) rtapi_print_msg(RTAPI_MSG_ERR, "microkernel: %s layout version %ld generation %ld, expected v%d\n",
+                                    path, (long)ptr[SHM_VERSION], (long)ptr[SHM_GENERATION], SHM_LAYOUT_VERSION);
+        munmap((void *)ptr, st.st_size);
+        return NULL;
+    }
+
+    *locked = (mlock((void *)ptr, st.st_size) == 0);
+    if (!*locked) {
+        rtapi_print_msg(RTAPI_MSG_WARN, "microkernel: mlock failed, first accesses may fault\n");
+    }
+    *ino = st.st_ino;
+    *len = st.st_size;
+    rtapi_print_msg(RTAPI_MSG_INFO, "microkernel: %s mapped, %s\n", path,
+                    ptr[SHM_BACKING] == BACKING_HUGE ? "one huge page" : "4 KB pages");
+    return ptr;
+}
+
+static void unmap_segment(volatile int64_t *ptr, size_t len) {
+    if (ptr) munmap((void *)ptr, len);
+}
+
+// One reattach check: notice a new segment at seg->path, map it,
+// publish the instance table into it and hand it to the RT functions
+static void reattach_poll(shm_segment_t *seg) {
+    volatile int64_t *ptr;
+    struct stat st;
+    ino_t ino;
+    size_t len;
+    int locked, k, i, r;
+
+    // Free each old mapping once every instance has switched past it. An
+    // instance that lags (thread stopped, functions never added) only
+    // keeps its mapping alive; the rest of the poll goes on regardless.
+    for (r = 0; r < seg->num_retired; ) {
+        for (k = 0; k < num_instances; k++) {
+            if (instances[k]->seg != seg) continue;
+            if ((int)(__atomic_load_n(&instances[k]->attach, __ATOMIC_ACQUIRE) - seg->retired[r].gone) < 0) break;
+        }
+        if (k < num_instances) {
+            r++;
+            continue;
+        }
+        unmap_segment(seg->retired[r].ptr, seg->retired[r].len);
+        seg->retired[r] = seg->retired[--seg->num_retired];
+    }
+
+    if (stat(seg->path, &st) != 0) {
+        __atomic_store_n(&seg->current, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    if (seg->ptr && st.st_ino == seg->ino) {
+        __atomic_store_n(&seg->current, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_store_n(&seg->current, 0, __ATOMIC_RELAXED);
+    // No room to retire the current mapping: stay disconnected until a
+    // lagging instance catches up
+    if (seg->ptr && seg->num_retired == RETIRED_MAX) return;
+
+    ptr = map_segment(seg->path, &ino, &locked, &len, 1);
+    if (!ptr) return;   // New daemon not ready yet; next poll
+
+    // Pins were created at load and cannot change now
+    for (k = 0; k < num_instances; k++) {
+        hal_microkernel_t *data = instances[k];
+
+        if (data->seg != seg) continue;
+        for (i = data->first; i < data->end; i++) {
+            int type = data->slot[i - data->first].type;
+            int now = ((volatile uint8_t *)&ptr[SHM_TYPES])[i];
+
+            if (type != SLOT_ALL && type != now) {
+                rtapi_print_msg(RTAPI_MSG_WARN, "microkernel: slot %d type changed %d -> %d, reload to re-export\n",
+                                i, type, now);
+            }
+        }
+        ptr[SHM_INST(k) + INST_FIRST] = data->first;
+        ptr[SHM_INST(k) + INST_SLOTS] = data->end - data->first;
+    }
+    publish_ring(seg, ptr);
+    publish_interp(seg, ptr);
+
+    if (seg->ptr) {
+        seg->retired[seg->num_retired].ptr = seg->ptr;
+        seg->retired[seg->num_retired].len = seg->len;
+        seg->retired[seg->num_retired].gone = seg->attach + 1;
+        seg->num_retired++;
+    }
+    seg->len = len;
+    seg->ino = ino;
+    seg->locked = locked;
+    __atomic_store_n(&seg->ptr, ptr, __ATOMIC_RELAXED);
+    __atomic_store_n(&seg->attach, seg->attach + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&seg->current, 1, __ATOMIC_RELAXED);
+    rtapi_print_msg(RTAPI_MSG_INFO, "microkernel: %s attached to daemon generation %ld\n",
+                    seg->path, (long)ptr[SHM_GENERATION]);
+}
+
+static void *reattach_thread(void *arg) {
+    struct timespec ts = { 0, REATTACH_POLL_NS };
+    int k;
+
+    (void)arg;
+    while (!__atomic_load_n(&reattach_stop, __ATOMIC_ACQUIRE)) {
+        for (k = 0; k < num_segments; k++) reattach_poll(&segments[k]);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+// RT side of a reattach: move this instance to the newest mapping, take
+// the float scales from it and resync every OUT pin. Returns the mapping
+// to use for this period (NULL while no daemon has been seen).
+static inline volatile int64_t *instance_shm(hal_microkernel_t *data) {
+    unsigned attach = __atomic_load_n(&data->seg->attach, __ATOMIC_ACQUIRE);
+    int i;
+
+    if (attach != data->attach) {
+        data->shm = __atomic_load_n(&data->seg->ptr, __ATOMIC_RELAXED);
+        for (i = data->first; i < data->end; i++) {
+            hal_microkernel_slot_t *slot = &data->slot[i - data->first];
+
+            if (slot->type != SLOT_FLOAT) continue;
+            slot->scale = (double)data->shm[SHM_SCALE + i];
+            data->divisor[i - data->first] = (slot->scale != 0.0) ? slot->scale : 1.0;
+        }
+        memset(data->in_unacked, 0, sizeof(data->in_unacked));
+        data->in_resync = 1;
+        data->in_published = -1;
+        data->out_resync = 1;
+        data->out_acked = -1;
+        *(data->generation) = (hal_u32_t)data->shm[SHM_GENERATION];
+        *(data->mem_locked) = data->seg->locked;
+        *(data->reattach_count) += 1;
+        // Stay tripped until the new daemon's heartbeat moves
+        data->last_heartbeat = data->shm[SHM_HEARTBEAT];
+        data->heartbeat_age = 0;
+        for (i = 0; i < data->num_interp; i++) data->interp[i].n = 0;
+        data->band_epoch = -1;
+        data->cap_seen = data->shm[SHM_CAPTURE + CAP_ARM];
+        data->cap.state = CAP_IDLE;
+        __atomic_store_n(&data->attach, attach, __ATOMIC_RELEASE);
+    }
+    *(data->connected) = (data->shm != NULL) && !data->tripped
+                         && __atomic_load_n(&data->seg->current, __ATOMIC_RELAXED);
+    return data->shm;
+}
+
+/*
+ * Seqlock protocol: a writer bumps its sequence word to odd, stores the
+ * frame (values + dirty bits), then bumps it back to even. A reader
+ * samples the sequence, copies what it needs, and keeps the copy only
+ * if the sequence was even and unchanged. The bridge never waits: it
+ * writes IN frames unconditionally and gives up on an OUT frame after
+ * SEQ_READ_TRIES without acking it, so its slots stay flagged for the
+ * next period.
+ */
+
+// Append one record to the sample ring. Single producer, single
+// consumer: the bridge owns the head, the daemon owns the tail. When
+// the daemon falls behind the record is dropped and counted; RT never
+// waits for it.
+static inline void ring_append(hal_microkernel_t *data, volatile int64_t *shm, const int64_t *in_vals) {
+    int64_t head = shm[SHM_RING_HEAD];
+    int64_t tail = __atomic_load_n(&shm[SHM_RING_TAIL], __ATOMIC_ACQUIRE);
+    volatile int64_t *rec;
+    int c;
+
+    if (head - tail >= RING_RECORDS) {
+        shm[SHM_RING_DROPPED] += 1;
+        *(data->ring_dropped) += 1;
+        return;
+    }
+    rec = &shm[SHM_RING_BASE + (head % RING_RECORDS) * RING_RECORD_WORDS];
+    rec[0] = rtapi_get_time();
+    for (c = 0; c < ring_width; c++) rec[1 + c] = in_vals[sample[c]];
+    __atomic_store_n(&shm[SHM_RING_HEAD], head + 1, __ATOMIC_RELEASE);
+}
+
+// Take the instance's deadbands from the table. Only runs when the
+// daemon bumps the epoch, so the per-period cost is one compare.
+static void deadband_load(hal_microkernel_t *data, volatile int64_t *shm) {
     int i;
-    int pin_offset;
+
+    data->band_epoch = shm[SHM_BAND_EPOCH];
+    for (i = data->first; i < data->end; i++) {
+        hal_microkernel_slot_t *slot = &data->slot[i - data->first];
+        int64_t abs_raw = shm[SHM_BAND_ABS + i];
+        int64_t rel_ppm = shm[SHM_BAND_REL + i];
+
+        slot->band_abs = (slot->type == SLOT_FLOAT) ? slot_to_float(slot, abs_raw) : (double)abs_raw;
+        slot->band_rel = (double)rel_ppm / 1e6;
+        slot->banded = (abs_raw != 0 || rel_ppm != 0) && slot->type != SLOT_BIT;
+    }
+}
+
+// A slot value as a number, for comparisons across types
+static inline double slot_value_as_double(const hal_microkernel_slot_t *slot, int64_t raw) {
+    switch (slot->type) {
+    case SLOT_FLOAT: return slot_to_float(slot, raw);
+    case SLOT_U32:
+    case SLOT_U64:   return (double)(uint64_t)raw;
+    default:         return (double)raw;
+    }
+}
+
+// A new IN value close enough to the last published one to be noise
+static inline int within_deadband(const hal_microkernel_slot_t *slot, int64_t val, int64_t last) {
+    double a = slot_value_as_double(slot, val);
+    double b = slot_value_as_double(slot, last);
+    double d;
+
+    d = (a > b) ? a - b : b - a;
+    if (b < 0) b = -b;
+    return d <= slot->band_abs || d <= slot->band_rel * b;
+}
+
+// Take a new capture configuration. Only runs when CAP_ARM moves, so an
+// idle capture costs one compare per period; everything the tool wrote
+// is checked here so the per-period path can trust it.
+static void capture_arm(hal_microkernel_t *data, volatile int64_t *shm) {
+    volatile int64_t *ctl = &shm[SHM_CAPTURE];
+    capture_t *cap = &data->cap;
+    int64_t trig = ctl[CAP_TRIG_SLOT];
+    int c;
+
+    data->cap_seen = __atomic_load_n(&ctl[CAP_ARM], __ATOMIC_ACQUIRE);
+    cap->state = CAP_IDLE;
+    if (trig < data->first || trig >= data->end) return;   // Another instance's trigger
+
+    cap->width = (int)ctl[CAP_WIDTH];
+    cap->slot = (int)(trig - data->first);
+    cap->cond = (int)ctl[CAP_COND];
+    cap->level = slot_value_as_double(&data->slot[cap->slot], ctl[CAP_LEVEL]);
+    cap->pre = (int)ctl[CAP_PRE];
+    cap->post = (int)ctl[CAP_POST];
+    cap->n = 0;
+    cap->state = CAP_ARMED;
+    if (cap->width < 1 || cap->width > CAP_WIDTH_MAX || cap->cond < CAP_RISING || cap->cond > CAP_NOW
+        || cap->pre < 0 || cap->post < 0 || cap->pre + cap->post >= CAP_RECORDS) {
+        cap->state = CAP_ERROR;
+    }
+    for (c = 0; c < CAP_WIDTH_MAX && cap->state == CAP_ARMED; c++) {
+        cap->cols[c] = (int)ctl[CAP_COLS + c];
+        if (c < cap->width && (cap->cols[c] < 0 || cap->cols[c] >= CAP_OUT + MAX_PINS)) cap->state = CAP_ERROR;
+    }
+    // The tool reads STATE once SEQ matches its arm: SEQ goes last, or a
+    // re-arm could show the new SEQ beside the last capture's CAP_DONE
+    ctl[CAP_FIRST] = 0;
+    ctl[CAP_COUNT] = 0;
+    __atomic_store_n(&ctl[CAP_STATE], cap->state, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctl[CAP_SEQ], data->cap_seen, __ATOMIC_RELEASE);
+    if (cap->state == CAP_ERROR) cap->state = CAP_IDLE;
+}
+
+// One capture record per period while armed: the columns as sampled
+// this period (own IN slots before any deadband), then the trigger test
+// and, once post records follow it, the hand-off to the tool.
+static inline void capture_step(hal_microkernel_t *data, volatile int64_t *shm, const int64_t *in_vals) {
+    volatile int64_t *ctl = &shm[SHM_CAPTURE];
+    capture_t *cap = &data->cap;
+    volatile int64_t *rec = &ctl[CAP_BUFFER + (cap->n % CAP_RECORDS) * CAP_RECORD_WORDS];
+    int64_t val = in_vals[data->first + cap->slot];
+    int c, fired = 0;
+
+    rec[0] = rtapi_get_time();
+    for (c = 0; c < cap->width; c++) {
+        int col = cap->cols[c];
+
+        if (col >= CAP_OUT) {
+            rec[1 + c] = shm[SHM_OUT_BASE + col - CAP_OUT];
+        } else if (col >= data->first && col < data->end) {
+            rec[1 + c] = in_vals[col];
+        } else {
+            rec[1 + c] = shm[SHM_IN_BASE + col];
+        }
+    }
+
+    if (cap->state == CAP_ARMED) {
+        const hal_microkernel_slot_t *slot = &data->slot[cap->slot];
+        double now = slot_value_as_double(slot, val);
+        double was = slot_value_as_double(slot, cap->prev);
+
+        switch (cap->cond) {
+        case CAP_RISING:  fired = cap->n > 0 && was < cap->level && now >= cap->level; break;
+        case CAP_FALLING: fired = cap->n > 0 && was > cap->level && now <= cap->level; break;
+        case CAP_CHANGE:  fired = cap->n > 0 && val != cap->prev; break;
+        default:          fired = 1; break;
+        }
+        if (fired) {
+            cap->trig = cap->n;
+            cap->state = CAP_TRIGGERED;
+            __atomic_store_n(&ctl[CAP_STATE], CAP_TRIGGERED, __ATOMIC_RELAXED);
+        }
+    }
+    cap->prev = val;
+    cap->n++;
+
+    if (cap->state == CAP_TRIGGERED && cap->n > cap->trig + cap->post) {
+        int64_t pre = (cap->trig < cap->pre) ? cap->trig : cap->pre;
+
+        ctl[CAP_FIRST] = (cap->trig - pre) % CAP_RECORDS;
+        ctl[CAP_COUNT] = pre + 1 + cap->post;
+        ctl[CAP_TRIG_REC] = pre;
+        cap->state = CAP_IDLE;
+        __atomic_store_n(&ctl[CAP_STATE], CAP_DONE, __ATOMIC_RELEASE);
+    }
+}
+
+// One period on the instance's clock, which the command ring and the
+// interpolator run on. write_frame advances it; read_frame does when
+// no write ran since its last call, as on an instance added only as
+// <name>.read.
+static inline void tick_advance(hal_microkernel_t *data, volatile int64_t *shm) {
+    *(data->update_count) += 1;
+    shm[SHM_INST(data->index) + INST_TICK] = *(data->update_count);
+}
+
+// HAL IN pins -> SHM
+static void write_frame(hal_microkernel_t *data) {
+    volatile int64_t *shm;
+    volatile uint64_t *in_dirty;
+    volatile int64_t *in_seq;
+    int64_t in_vals[MAX_PINS];
+    uint64_t changed[DIRTY_WORDS] = { 0 };
+    uint64_t any_changed = 0;
+    uint64_t bits;
+    int64_t seq;
+    int i, w;
     
-    if (shm_ptr == NULL) return;
+    shm = instance_shm(data);
+    if (shm == NULL) return;
+    if (shm[SHM_BAND_EPOCH] != data->band_epoch) deadband_load(data, shm);
+
+    in_dirty  = (volatile uint64_t *)&shm[SHM_INST(data->index) + INST_IN_DIRTY];
+    in_seq    = &shm[SHM_INST(data->index) + INST_IN_SEQ];
 
     // READ FROM HAL (IN PINS) -> WRITE TO SHM
-    for (i = 0; i < MAX_PINS; i++) {
-        pin_offset = 2 + i;
-        
-        // Priority logic: S32 > Float > Bit
-        // If multiple are connected, the last one wins. 
-        // Typically user only connects one type per index.
-        
-        int64_t val = 0;
-        
-        // Check Bit
-        if (*(data->bit_in[i])) val = 1;
+    // Sample every IN pin first and compare with the local shadow of
+    // what was last published, then publish only the changed slots as
+    // one frame. A quiet period neither reads nor writes the IN lines,
+    // so the daemon core keeps its cached copies.
+    for (i = data->first; i < data->end; i++) {
+        hal_microkernel_slot_t *slot = &data->slot[i - data->first];
+        int64_t val = sample_in_pin(slot);
+        int64_t last = data->in_shadow[i - data->first];
         
-        // Check S32 (Overwrite if non-zero, or just take raw value)
-        // We assume the user connects the correct type. 
-        // We'll effectively OR them or just take the S32 if connected.
-        // Simple approach: Check s32 first? No, let's just sum them (unsafe but works if only 1 connected)
-        // Better: Just check S32.
-        
-        int64_t s32_val = *(data->s32_in[i]);
-        if (s32_val != 0) val = s32_val;
-        
-        // Write to SHM as generic integer
-        shm_ptr[pin_offset] = val;
+        in_vals[i] = val;
+        if (data->in_resync || (last != val && !(slot->banded && within_deadband(slot, val, last)))) {
+            changed[i >> 6] |= 1ULL << (i & 63);
+            any_changed = 1;
+        }
     }
+    data->in_resync = 0;
+
+    if (any_changed) {
+        // The published bitmap holds every slot changed since the frame
+        // the daemon last acked. Once it has acked our latest frame it
+        // has seen all of them and the bitmap starts over.
+        if (__atomic_load_n(&shm[SHM_IN_ACK + data->index], __ATOMIC_ACQUIRE) == data->in_published) {
+            memset(data->in_unacked, 0, sizeof(data->in_unacked));
+        }
+        seq = *in_seq;
+        __atomic_store_n(in_seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        for (w = data->first_word; w < data->end_word; w++) {
+            bits = changed[w];
+            while (bits) {
+                i = (w << 6) + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                shm[SHM_IN_BASE + i] = in_vals[i];
+                data->in_shadow[i - data->first] = in_vals[i];
+            }
+            data->in_unacked[w] |= changed[w];
+            in_dirty[w] = data->in_unacked[w];
+        }
+
+        __atomic_store_n(in_seq, seq + 2, __ATOMIC_RELEASE);
+        data->in_published = seq + 2;
+    }
+
+    if (data->ring) ring_append(data, shm, in_vals);
+    if (shm[SHM_CAPTURE + CAP_ARM] != data->cap_seen) capture_arm(data, shm);
+    if (data->cap.state != CAP_IDLE) capture_step(data, shm, in_vals);
+
+    tick_advance(data, shm);
+    data->wrote = 1;
+}
+
+// Daemon watchdog: trip after `watchdog` periods without a heartbeat,
+// recover (and resync every OUT pin) as soon as it moves again
+static inline void watchdog_check(hal_microkernel_t *data, volatile int64_t *shm) {
+    int64_t heartbeat = shm[SHM_HEARTBEAT];
+
+    if (heartbeat != data->last_heartbeat) {
+        data->last_heartbeat = heartbeat;
+        data->heartbeat_age = 0;
+        if (data->tripped) {
+            data->tripped = 0;
+            data->out_resync = 1;
+            *(data->watchdog_tripped) = 0;
+        }
+    } else if (watchdog > 0 && !data->tripped && ++data->heartbeat_age >= watchdog) {
+        data->tripped = 1;
+        *(data->watchdog_tripped) = 1;
+    }
+}
+
+// One period of an interpolation channel: pull queued points into the
+// window, then drive the slot from the segment around the current tick.
+// Before the first point the pin is left alone; past the last point it
+// holds that value, and entering the hold counts as an underrun.
+static inline void interp_apply(hal_microkernel_t *data, interp_channel_t *ch, volatile int64_t *shm) {
+    volatile int64_t *ring = &shm[INTERP(ch->index)];
+    hal_microkernel_slot_t *slot = &data->slot[ch->slot];
+    int64_t now = *(data->update_count);    // Already advanced this period, read-only instance too
+    int64_t head = __atomic_load_n(&ring[INTERP_HEAD], __ATOMIC_ACQUIRE);
+    int64_t tail = ring[INTERP_TAIL];
+    const interp_point_t *p0, *p1, *p2, *p3;
+    double u, u2, u3, span, m1, m2, v;
+    int k;
+
+    // Keep one point behind and two ahead of the current tick
+    while (tail != head && (ch->n < 4 || ch->pts[2].tick <= now)) {
+        volatile int64_t *e = &ring[INTERP_POINTS + (tail % INTERP_SIZE) * 2];
+
+        if (ch->n == 4) {
+            memmove(&ch->pts[0], &ch->pts[1], 3 * sizeof(interp_point_t));
+            ch->n = 3;
+        }
+        ch->pts[ch->n].tick = e[0];
+        ch->pts[ch->n].value = slot_to_float(slot, e[1]);
+        ch->n++;
+        tail++;
+    }
+    __atomic_store_n(&ring[INTERP_TAIL], tail, __ATOMIC_RELEASE);
+
+    for (k = ch->n - 1; k >= 0 && ch->pts[k].tick > now; k--);
+    if (k < 0) return;
+
+    if (k == ch->n - 1) {
+        v = ch->pts[k].value;
+        if (!ch->holding && ch->n > 1) *(data->interp_underruns) += 1;
+        ch->holding = 1;
+    } else {
+        p1 = &ch->pts[k];
+        p2 = &ch->pts[k + 1];
+        span = (double)(p2->tick - p1->tick);
+        u = (double)(now - p1->tick) / span;
+        if (ring[INTERP_MODE] == INTERP_CUBIC) {
+            // Hermite with Catmull-Rom tangents, scaled for uneven spacing
+            p0 = (k > 0) ? &ch->pts[k - 1] : p1;
+            p3 = (k + 2 < ch->n) ? &ch->pts[k + 2] : p2;
+            m1 = (p0 == p1) ? p2->value - p1->value
+                            : (p2->value - p0->value) * span / (double)(p2->tick - p0->tick);
+            m2 = (p3 == p2) ? p2->value - p1->value
+                            : (p3->value - p1->value) * span / (double)(p3->tick - p1->tick);
+            u2 = u * u;
+            u3 = u2 * u;
+            v = (2 * u3 - 3 * u2 + 1) * p1->value + (u3 - 2 * u2 + u) * m1
+              + (-2 * u3 + 3 * u2) * p2->value + (u3 - u2) * m2;
+        } else {
+            v = p1->value + u * (p2->value - p1->value);
+        }
+        ch->holding = 0;
+    }
+    *(slot->float_out) = v;
+}
+
+// Drive the OUT pins for every queued command that is due. Entries are
+// taken in queue order and the head entry gates the rest, so the daemon
+// must queue in target order. A command sets the pin only; the slot's
+// next OUT write from the daemon takes over again.
+static inline void cmd_apply(hal_microkernel_t *data, volatile int64_t *shm, long period) {
+    volatile int64_t *ring = &shm[CMD_RING(data->index)];
+    int64_t head = __atomic_load_n(&ring[CMD_HEAD], __ATOMIC_ACQUIRE);
+    int64_t tail = ring[CMD_TAIL];
+    int64_t now = 0, late;
+    volatile int64_t *e;
+    int slot;
+
+    if (head == tail) return;
+    while (tail != head) {
+        e = &ring[CMD_ENTRIES + (tail % CMD_SIZE) * CMD_ENTRY_WORDS];
+        if (e[3] == CMD_AT_TIME) {
+            if (now == 0) now = rtapi_get_time();
+            late = now - e[0];
+            if (late < 0) break;
+            if (period > 0) late /= period;     // Whole periods past the target
+        } else {
+            late = (int64_t)*(data->update_count) - e[0];
+            if (late < 0) break;
+        }
+
+        slot = (int)e[1];
+        if (slot < data->first || slot >= data->end || (cmd_late_limit >= 0 && late > cmd_late_limit)) {
+            ring[CMD_MISSED] += 1;
+            *(data->cmd_missed) += 1;
+        } else {
+            if (late > 0) {
+                ring[CMD_LATE] += 1;
+                *(data->cmd_late) += 1;
+            }
+            drive_out_pin(&data->slot[slot - data->first], e[2]);
+            *(data->cmd_applied) += 1;
+        }
+        tail++;
+    }
+    __atomic_store_n(&ring[CMD_TAIL], tail, __ATOMIC_RELEASE);
+}
+
+// SHM -> HAL OUT pins
+static void read_frame(hal_microkernel_t *data, long period) {
+    volatile int64_t *shm;
+    volatile uint64_t *out_dirty;
+    volatile int64_t *out_seq;
+    int64_t out_vals[MAX_PINS];
+    uint64_t pending[DIRTY_WORDS];
+    uint64_t bits;
+    int64_t seq, seq_end;
+    fanout_block_t blk;
+    int i, w, n, base, tries;
+    
+    shm = instance_shm(data);
+    if (shm == NULL) return;
+    if (!data->wrote) tick_advance(data, shm);
+    data->wrote = 0;
+    watchdog_check(data, shm);
+
+    out_dirty = (volatile uint64_t *)&shm[SHM_OUT_DIRTY];
+    out_seq   = &shm[SHM_OUT_SEQ];
 
     // READ FROM SHM -> WRITE TO HAL (OUT PINS)
-    for (i = 0; i < MAX_PINS; i++) {
-        pin_offset = 2 + i;
-        int64_t val = shm_ptr[pin_offset];
-        
-        // Broadcast value to all types
-        *(data->bit_out[i])   = (val != 0);
-        *(data->s32_out[i])   = (hal_s32_t)val;
-        *(data->float_out[i]) = (hal_float_t)val;
+    // While the OUT sequence stands at the frame we last acked there is
+    // nothing new and the OUT lines are left alone. Otherwise copy this
+    // instance's dirty bits and the flagged values under the OUT
+    // seqlock, visit them lowest set bit first, then ack the frame. The
+    // bitmap still holds slots from frames we already applied until the
+    // daemon sees our ack; their write sequence is not past our ack, so
+    // they are skipped and cannot undo a command applied since.
+    for (tries = 0; tries < SEQ_READ_TRIES; tries++) {
+        seq = __atomic_load_n(out_seq, __ATOMIC_ACQUIRE);
+        if (seq == data->out_acked && !data->out_resync) break;
+        if (seq & 1) continue;
+
+        for (w = data->first_word; w < data->end_word; w++) {
+            // Take only this instance's bits; other instances share the words
+            bits = data->out_resync ? data->own_mask[w] : (out_dirty[w] & data->own_mask[w]);
+            if (!data->out_resync) {
+                uint64_t t = bits;
+
+                while (t) {
+                    i = (w << 6) + __builtin_ctzll(t);
+                    t &= t - 1;
+                    if (shm[SHM_OUT_WSEQ + i] <= data->out_acked) bits &= ~(1ULL << (i & 63));
+                }
+            }
+            pending[w] = bits;
+            if (__builtin_popcountll(bits) >= FANOUT_DENSE_BITS) {
+                // Dense word: copy the whole owned block for the fan-out kernel
+                base = (w << 6) > data->first ? (w << 6) : data->first;
+                n = ((w + 1) << 6) < data->end ? ((w + 1) << 6) - base : data->end - base;
+                for (i = base; i < base + n; i++) out_vals[i] = shm[SHM_OUT_BASE + i];
+                continue;
+            }
+            while (bits) {
+                i = (w << 6) + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                out_vals[i] = shm[SHM_OUT_BASE + i];
+            }
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq_end = __atomic_load_n(out_seq, __ATOMIC_RELAXED);
+        if (seq_end == seq) break;
     }
 
-    shm_ptr[1] = 1; // Update flag
-    *(data->update_count) += 1;
+    if (tries == SEQ_READ_TRIES) {
+        // Writer busy all along: nothing acked, so the daemon keeps the
+        // slots flagged and we try again next period
+        *(data->seq_retries) += 1;
+    } else if (seq != data->out_acked || data->out_resync) {
+        for (w = data->first_word; w < data->end_word; w++) {
+            bits = pending[w];
+            if (__builtin_popcountll(bits) >= FANOUT_DENSE_BITS) {
+                base = (w << 6) > data->first ? (w << 6) : data->first;
+                n = ((w + 1) << 6) < data->end ? ((w + 1) << 6) - base : data->end - base;
+                fanout(&out_vals[base], &data->divisor[base - data->first], n, &blk);
+                while (bits) {
+                    i = (w << 6) + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    drive_out_staged(&data->slot[i - data->first], &blk, i - base, out_vals[i]);
+                }
+                continue;
+            }
+            while (bits) {
+                i = (w << 6) + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                
+                drive_out_pin(&data->slot[i - data->first], out_vals[i]);
+            }
+        }
+        data->out_resync = 0;
+        data->out_acked = seq;
+        __atomic_store_n(&shm[SHM_INST(data->index) + INST_OUT_ACK], seq, __ATOMIC_RELEASE);
+    }
+
+    for (i = 0; i < data->num_interp; i++) interp_apply(data, &data->interp[i], shm);
+    cmd_apply(data, shm, period);
+
+    // Tripped: whatever the segment says, hold the safe values
+    if (data->tripped) {
+        for (i = 0; i < data->num_safe; i++) {
+            hal_microkernel_slot_t *slot = &data->slot[data->safe[i].slot];
+
+            if (slot->type != SLOT_FLOAT) drive_out_pin(slot, data->safe[i].ival);
+            // drive_out_pin would give SLOT_ALL's float pin the truncated integer
+            if (slot->type == SLOT_FLOAT || slot->type == SLOT_ALL) *(slot->float_out) = data->safe[i].fval;
+        }
+    }
+}
+
+// Start of an exported function: period jitter, and reset-max
+static inline long long timing_begin(hal_microkernel_t *data, fn_timing_t *t, long period) {
+    long long now = rtapi_get_time();
+    long long jitter;
+    int k;
+
+    if (*(data->reset_max)) {
+        for (k = 0; k < FN_COUNT; k++) {
+            *(data->timing[k].tmax) = 0;
+            *(data->timing[k].jitter_max) = 0;
+        }
+        *(data->reset_max) = 0;
+    }
+    if (t->last_start != 0) {
+        jitter = (now - t->last_start) - period;
+        *(t->jitter) = (hal_s32_t)jitter;
+        if (jitter < 0) jitter = -jitter;
+        if (jitter > *(t->jitter_max)) *(t->jitter_max) = (hal_s32_t)jitter;
+    }
+    t->last_start = now;
+    return now;
+}
+
+// End of an exported function: last, max and average execution time
+static inline void timing_end(fn_timing_t *t, long long start) {
+    hal_s32_t dt = (hal_s32_t)(rtapi_get_time() - start);
+
+    *(t->time) = dt;
+    if (dt > *(t->tmax)) *(t->tmax) = dt;
+    t->avg_sum += dt - (t->avg_sum >> TIMING_EWMA_SHIFT);
+    *(t->tavg) = (hal_s32_t)(t->avg_sum >> TIMING_EWMA_SHIFT);
+}
+
+// <name>.write: HAL IN pins -> SHM. Put it at the end of the thread
+// so the daemon sees this period's values.
+static void write_pins(void *arg, long period) {
+    hal_microkernel_t *data = (hal_microkernel_t *)arg;
+    long long start = timing_begin(data, &data->timing[FN_WRITE], period);
+
+    write_frame(data);
+    timing_end(&data->timing[FN_WRITE], start);
+}
+
+// <name>.read: SHM -> HAL OUT pins. Put it at the start of the
+// thread so this period's consumers see the daemon's latest values.
+static void read_pins(void *arg, long period) {
+    hal_microkernel_t *data = (hal_microkernel_t *)arg;
+    long long start = timing_begin(data, &data->timing[FN_READ], period);
+
+    read_frame(data, period);
+    timing_end(&data->timing[FN_READ], start);
+}
+
+// <name>.update: both halves in one function, as before the split
+static void update_pins(void *arg, long period) {
+    hal_microkernel_t *data = (hal_microkernel_t *)arg;
+    long long start = timing_begin(data, &data->timing[FN_UPDATE], period);
+
+    write_frame(data);
+    read_frame(data, period);
+    timing_end(&data->timing[FN_UPDATE], start);
 }
 
 void rtapi_app_exit(void) {
-    unmap_shared_memory();
+    int k;
+
+    if (reattach_running) {
+        __atomic_store_n(&reattach_stop, 1, __ATOMIC_RELEASE);
+        pthread_join(reattach_tid, NULL);
+    }
+    for (k = 0; k < num_segments; k++) {
+        int r;
+
+        for (r = 0; r < segments[k].num_retired; r++) unmap_segment(segments[k].retired[r].ptr, segments[k].retired[r].len);
+        unmap_segment(segments[k].ptr, segments[k].len);
+    }
+    // hal_exit frees the stubs; a later load must allocate new ones
+    stub_in = NULL;
+    stub_out = NULL;
     hal_exit(comp_id);
 }